@@ -0,0 +1,33 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <QDir>
+#include <optional>
+#include <tuple>
+
+/**
+ * @brief The AssetCache class is a machine wide cache of images and renderings shared by
+ * projects, sessions and concurrent processes:
+ *      blobs/<sha1 of content>
+ *      keys/<sha1 of key>, refers a blob and tells its format
+ * Files are replaced atomically, so readers see either nothing or a whole file. Over the limit
+ * the least recently used blobs are removed by one process at a time.
+ */
+class AssetCache {
+public:
+    explicit AssetCache(const QString& dirName = defaultDir());
+    static QString defaultDir();
+    void setLimit(qint64 bytes);
+    bool isEnabled() const;
+    std::optional<std::tuple<QByteArray, int>> find(const QString& key);
+    void insert(const QString& key, const QByteArray& bytes, int format);
+private:
+    QString keyFile(const QString& key) const;
+    void trim();
+private:
+    QDir m_dir;
+    qint64 m_limit = 0;
+    qint64 m_written = 0; // since the last trim
+};
+
+#endif // ASSETCACHE_H
@@ -2,7 +2,10 @@
 #define DOWNLOADS_H
 
 #include <QObject>
+#include <QTimer>
+#include <QVariantMap>
 #include <unordered_map>
+#include <array>
 
 class QNetworkReply;
 
@@ -14,34 +17,63 @@ class Downloads : public QObject {
     Q_PROPERTY(qint64 bytesTotal READ bytesTotal NOTIFY bytesTotalChanged)
     Q_PROPERTY(int downloads READ downloads NOTIFY downloadsChanged)
     Q_PROPERTY(bool downloading READ downloading NOTIFY downloadingChanged)
+    Q_PROPERTY(QVariantMap categories READ categories NOTIFY categoriesChanged)
 public:
+    enum Category {Document, Images, Renderings, Nodes, Other, CategoryCount};
+    Q_ENUM(Category)
     Downloads(QObject* parent);
     Q_INVOKABLE void cancel();
     void reset();
-    void setProgress(QNetworkReply* reply, qint64 bytesReceived, qint64 bytesTotal);
+    void setProgress(QNetworkReply* reply, qint64 bytesReceived, qint64 bytesTotal, Category category = Other);
     qint64 bytesReceived() const;
     qint64 bytesTotal() const;
     int downloads() const;
     bool downloading() const;
     int activeDownloads() const;
+    QVariantMap categories() const;
     void monitor(QNetworkReply*, const NetworkFunction& f);
     NetworkFunction monitored(QNetworkReply*);
 signals:
     void bytesReceivedChanged();
     void bytesTotalChanged();
     void downloadsChanged();
+    // for each reply, downloadingChanged tells when the first starts and the last ends
     void downloadStart();
     void downloadEnd();
     void downloadingChanged();
     void cancelled();
     void tooManyRequests();
+    void categoriesChanged();
 private slots:
     void onDestroy(QObject*);
+    void publish();
 private:
-    std::unordered_map<QNetworkReply*, std::tuple<qint64, qint64, NetworkFunction>> m_progresses;
-    int m_past = 0;
-    qint64 m_bytesReceived = 0;
-    qint64 m_bytesTotal = 0;
+    struct Progress {
+        qint64 bytesReceived = 0;
+        qint64 bytesTotal = 0;
+        Category category = Other;
+        NetworkFunction call = nullptr;
+    };
+    struct Totals {
+        qint64 bytesReceived = 0;
+        qint64 bytesTotal = 0;
+        int downloads = 0;
+        bool operator==(const Totals& other) const {
+            return bytesReceived == other.bytesReceived && bytesTotal == other.bytesTotal && downloads == other.downloads;
+        }
+        bool operator!=(const Totals& other) const {return !(*this == other);}
+    };
+    void add(Category category, qint64 bytesReceived, qint64 bytesTotal, int downloads);
+    void setDownloading(bool downloading);
+private:
+    std::unordered_map<QNetworkReply*, Progress> m_progresses;
+    // running totals of active and past downloads, properties read the published ones
+    Totals m_totals;
+    std::array<Totals, CategoryCount> m_categories;
+    Totals m_published;
+    std::array<Totals, CategoryCount> m_publishedCategories;
+    bool m_downloading = false;
+    QTimer m_publish;
 };
 
 #endif // DOWNLOADS_H
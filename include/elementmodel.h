@@ -0,0 +1,44 @@
+#ifndef ELEMENTMODEL_H
+#define ELEMENTMODEL_H
+
+#include <QAbstractListModel>
+#include <QVariantMap>
+#include <QSet>
+#include <vector>
+
+class FigmaDocument;
+
+/**
+ * @brief The ElementModel class lists all elements of all canvases in the document
+ */
+class ElementModel : public QAbstractListModel {
+    Q_OBJECT
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+public:
+    enum Roles {
+        CanvasRole = Qt::UserRole + 1,
+        ElementRole,
+        CanvasNameRole,
+        ElementNameRole,
+        ReadyRole
+    };
+    using Index = QPair<int, int>; // canvas, element
+    explicit ElementModel(QObject* parent = nullptr);
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+    int count() const;
+    Q_INVOKABLE QVariantMap get(int row) const;
+    Q_INVOKABLE int row(int canvas, int element) const;
+    void setDocument(const FigmaDocument* doc, const QSet<Index>& pending = {});
+    void setReady(const Index& index);
+signals:
+    void countChanged();
+private:
+    const FigmaDocument* m_doc = nullptr;
+    std::vector<Index> m_indices;   // row -> canvas, element
+    std::vector<int> m_offsets;     // canvas -> 1st row
+    std::vector<bool> m_ready;
+};
+
+#endif // ELEMENTMODEL_H
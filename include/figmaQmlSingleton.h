@@ -26,9 +26,9 @@ public:
 
     void setView(int index)  {
         if(index < viewCount()) {
-            const auto el = m_fqml.elements();
-            m_fqml.setCurrentCanvas(el[index].toMap()["canvas"].toInt());
-            m_fqml.setCurrentElement(el[index].toMap()["element"].toInt());
+            const auto el = m_fqml.elements()->get(index);
+            m_fqml.setCurrentCanvas(el["canvas"].toInt());
+            m_fqml.setCurrentElement(el["element"].toInt());
         }
     }
 
@@ -40,13 +40,12 @@ public:
 
     Q_INVOKABLE QString view(int index) {
         if(index < viewCount()) {
-            const auto el = m_fqml.elements();
-            return el[index].toMap()["element_name"].toString();
+            return m_fqml.elements()->get(index)["element_name"].toString();
         }
         return {};
     }
     FigmaQmlSingleton(FigmaQml& fqml) : m_fqml(fqml) {
-        QObject::connect(&m_fqml, &FigmaQml::elementsChanged, this, &FigmaQmlSingleton::viewCountChanged);
+        QObject::connect(m_fqml.elements(), &ElementModel::countChanged, this, &FigmaQmlSingleton::viewCountChanged);
         QObject::connect(&m_fqml, &FigmaQml::currentCanvasChanged, this, &FigmaQmlSingleton::currentViewChanged);
         QObject::connect(&m_fqml, &FigmaQml::currentElementChanged, this, &FigmaQmlSingleton::currentViewChanged);
         QObject::connect(&m_fqml, &FigmaQml::currentElementChanged, this, [this]() {
@@ -55,7 +54,7 @@ public:
     }
 
     int viewCount() const {
-        return m_fqml.elements().size();
+        return m_fqml.elements()->count();
     }
 
     QString currentView() const {
@@ -1,107 +1,334 @@
 #ifndef FIGMADATA_H
 #define FIGMADATA_H
 
+#include "figmastore.h"
 #include <QString>
 #include <QHash>
 #include <QDataStream>
+#include <QReadWriteLock>
 #include <QMutex>
+#include <QFile>
+#include <QTemporaryDir>
+#include <list>
+#include <QDebug>
+#include <optional>
+#include <memory>
 #include <tuple>
 
-//TODO: Change to QReadWriteLock - for perf?
-#define MUTEX_LOCK(m) QMutexLocker _l(&m);
+// many readers (cachedImage etc. also from workers), writes are rare
+#define READ_LOCK(m) QReadLocker _l(&m);
+#define WRITE_LOCK(m) QWriteLocker _l(&m);
 
+/**
+ * @brief The FigmaBlobs class holds payloads by their content, caches sharing it keep a single copy
+ * of identical bytes however many ids refer to them. Over the budget the least recently used
+ * payloads are spilled to a temporary directory and read back when asked.
+ */
+class FigmaBlobs {
+public:
+    // in bytes, 0 is no limit
+    void setBudget(qint64 budget) {
+        QMutexLocker lock(&m_mutex);
+        m_budget = budget;
+        evict({});
+    }
+
+    // payloads in memory
+    qint64 bytes() const {
+        QMutexLocker lock(&m_mutex);
+        return m_bytes;
+    }
+
+    // hash is computed if not known
+    void intern(const QByteArray& bytes, QByteArray& hash) {
+        if(hash.isEmpty())
+            hash = FigmaStore::checksum(bytes);
+        QMutexLocker lock(&m_mutex);
+        auto it = m_blobs.find(hash);
+        if(it == m_blobs.end()) {
+            m_lru.push_front(hash);
+            m_blobs.insert(hash, {bytes, 1, true, false, m_lru.begin()});
+            m_bytes += bytes.size();
+            evict(hash);
+            return;
+        }
+        ++it->refs;
+        if(it->inMemory)
+            m_lru.splice(m_lru.begin(), m_lru, it->lru);
+    }
+
+    std::optional<QByteArray> get(const QByteArray& hash) {
+        QMutexLocker lock(&m_mutex);
+        const auto it = m_blobs.find(hash);
+        if(it == m_blobs.end())
+            return std::nullopt;
+        if(it->inMemory) {
+            m_lru.splice(m_lru.begin(), m_lru, it->lru);
+            return it->bytes;
+        }
+        QFile file(spillName(hash));
+        if(!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Spilled blob lost" << file.errorString() << file.fileName();
+            return std::nullopt;
+        }
+        const auto bytes = file.readAll();
+        it->bytes = bytes;
+        it->inMemory = true;
+        m_lru.push_front(hash);
+        it->lru = m_lru.begin();
+        m_bytes += bytes.size();
+        evict(hash);
+        return bytes;
+    }
+
+    void release(const QByteArray& hash) {
+        QMutexLocker lock(&m_mutex);
+        const auto it = m_blobs.find(hash);
+        Q_ASSERT(it != m_blobs.end());
+        if(it == m_blobs.end() || --it->refs > 0)
+            return;
+        if(it->inMemory) {
+            m_bytes -= it->bytes.size();
+            m_lru.erase(it->lru);
+        }
+        if(it->onDisk)
+            QFile::remove(spillName(hash));
+        m_blobs.erase(it);
+    }
+
+    int size() const {
+        QMutexLocker lock(&m_mutex);
+        return m_blobs.size();
+    }
+private:
+    QString spillName(const QByteArray& hash) const {
+        return m_spill->filePath(QString::fromLatin1(hash.toHex()));
+    }
+
+    // locked, others wait while spilled blobs are written
+    void evict(const QByteArray& keep) {
+        if(m_budget <= 0)
+            return;
+        auto lru = m_lru.end();
+        while(m_bytes > m_budget && lru != m_lru.begin()) {
+            --lru;
+            if(*lru == keep)
+                continue;
+            const auto it = m_blobs.find(*lru);
+            if(!it->onDisk) {
+                if(!m_spill)
+                    m_spill = std::make_unique<QTemporaryDir>();
+                QFile file(spillName(*lru));
+                if(!m_spill->isValid() || !file.open(QIODevice::WriteOnly) || file.write(it->bytes) != it->bytes.size()) {
+                    file.remove();
+                    continue; // stays in memory
+                }
+                it->onDisk = true; // content does not change, written once
+            }
+            m_bytes -= it->bytes.size();
+            it->bytes = QByteArray();
+            it->inMemory = false;
+            lru = m_lru.erase(lru);
+        }
+    }
+private:
+    struct Blob {
+        QByteArray bytes;
+        int refs;
+        bool inMemory;
+        bool onDisk;
+        std::list<QByteArray>::iterator lru;
+    };
+    QHash<QByteArray, Blob> m_blobs;
+    std::list<QByteArray> m_lru; // in memory, most recently used first
+    std::unique_ptr<QTemporaryDir> m_spill;
+    qint64 m_bytes = 0;
+    qint64 m_budget = 0;
+    mutable QMutex m_mutex;
+};
+
+/**
+ * @brief The FigmaData class is a thread safe id -> asset cache. Each operation is a single lookup
+ * under a read or write lock, payloads are implicitly shared so snapshots do not copy bytes.
+ * Entries read from a FigmaStore are committed but loaded only when their data is asked.
+ * With FigmaBlobs committed payloads are held there by content, and may be spilled to disk.
+ */
 class FigmaData {
     enum class State {Empty, Pending, Error, Committed};
 public:
+    struct Entry {
+        QString url;
+        QByteArray data;     // empty if in m_blobs or m_store
+        int format;
+        State state;
+        bool stored = false; // data is still in m_store
+        QByteArray hash;     // content in m_blobs, if interned
+        bool isEmpty() const {return state != State::Committed;}
+        bool isPending() const {return state == State::Pending;}
+        bool isError() const {return state == State::Error;}
+    };
+public:
+    FigmaData() = default;
+    explicit FigmaData(const std::shared_ptr<FigmaBlobs>& blobs) : m_blobs(blobs) {}
+    ~FigmaData() {clear();}
+
     bool contains(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
+        READ_LOCK(m_lock);
         return m_data.contains(key);
     }
 
+    // snapshot of an entry, nullopt if not there
+    std::optional<Entry> entry(const QString& key) const {
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        if(it == m_data.constEnd())
+            return std::nullopt;
+        return *it;
+    }
+
+    // data and format if committed
+    std::optional<std::tuple<QByteArray, int>> committed(const QString& key) const {
+        std::shared_ptr<FigmaStore> store;
+        FigmaStore::Section section;
+        QByteArray hash;
+        int format;
+        {
+            READ_LOCK(m_lock);
+            const auto it = m_data.constFind(key);
+            if(it == m_data.constEnd() || it->state != State::Committed)
+                return std::nullopt;
+            if(!it->stored && (it->hash.isEmpty() || !m_blobs))
+                return std::make_tuple(it->data, it->format);
+            store = m_store;
+            section = m_section;
+            hash = it->hash;
+            format = it->format;
+        }
+        if(hash.isEmpty())
+            return load(key, *store, section);
+        if(const auto bytes = m_blobs->get(hash))
+            return std::make_tuple(*bytes, format);
+        lost(key, hash);
+        return std::nullopt;
+    }
+
     bool isEmpty(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        return m_data[key].state != State::Committed;
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        Q_ASSERT(it != m_data.constEnd());
+        return it->state != State::Committed;
     }
 
     bool isError(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        return m_data[key].state == State::Error;
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        Q_ASSERT(it != m_data.constEnd());
+        return it->state == State::Error;
     }
 
     QByteArray data(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data[key].state == State::Committed);
-        Q_ASSERT(m_data.contains(key));
-        return m_data[key].data;
+        const auto item = committed(key);
+        Q_ASSERT(item);
+        return item ? std::get<QByteArray>(*item) : QByteArray();
     }
 
     int format(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        return m_data[key].format;
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        Q_ASSERT(it != m_data.constEnd());
+        return it->format;
     }
 
     void insert(const QString& key) {
-        MUTEX_LOCK(m_mutex);
+        WRITE_LOCK(m_lock);
         Q_ASSERT(!m_data.contains(key));
         m_data.insert(key, {{}, {}, 0, State::Empty});
     }
 
     void setUrl(const QString& key, const QString& url) {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        Q_ASSERT(m_data[key].url.isEmpty());
-        Q_ASSERT(m_data[key].state != State::Error);
-        m_data[key].url = url;
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        Q_ASSERT(it != m_data.end());
+        Q_ASSERT(it->url.isEmpty());
+        Q_ASSERT(it->state != State::Error);
+        it->url = url;
     }
 
     bool isPending(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        Q_ASSERT(m_data[key].state != State::Error);
-        return m_data[key].state == State::Pending;
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        Q_ASSERT(it != m_data.constEnd());
+        Q_ASSERT(it->state != State::Error);
+        return it->state == State::Pending;
     }
 
     QString url(const QString& key) const {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        Q_ASSERT(m_data[key].state != State::Error);
-        return m_data[key].url;
+        READ_LOCK(m_lock);
+        const auto it = m_data.constFind(key);
+        Q_ASSERT(it != m_data.constEnd());
+        Q_ASSERT(it->state != State::Error);
+        return it->url;
     }
     //Atomic get and set
     bool setPending(const QString& key) {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        const auto wasPending = m_data[key].state == State::Pending;
-        if(wasPending)
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        Q_ASSERT(it != m_data.end());
+        if(it->state == State::Pending)
             return false;
-        Q_ASSERT(m_data[key].state == State::Empty);
-        m_data[key].state = State::Pending;
+        Q_ASSERT(it->state == State::Empty);
+        it->state = State::Pending;
         return true;
     }
 
     void setError(const QString& key) {
-        MUTEX_LOCK(m_mutex);
-        Q_ASSERT(m_data.contains(key));
-        Q_ASSERT(m_data[key].state != State::Committed);
-        m_data[key].state = State::Error;
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        Q_ASSERT(it != m_data.end());
+        Q_ASSERT(it->state != State::Committed);
+        it->state = State::Error;
     }
 
     void setBytes(const QString& key, const QByteArray& bytes, int meta =  0) {
-        Q_ASSERT(m_data[key].state == State::Pending);
-        m_data[key].data = bytes;
-        m_data[key].format = meta;
-        m_data[key].state = State::Committed;
+        QByteArray hash;
+        const auto data = intern(bytes, hash);
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        Q_ASSERT(it != m_data.end());
+        Q_ASSERT(it->state == State::Pending);
+        it->data = data;
+        it->format = meta;
+        it->state = State::Committed;
+        it->stored = false;
+        it->hash = hash;
     }
+
+    //Atomic get and set, false if not there or already committed
+    bool commit(const QString& key, const QByteArray& bytes, int meta = 0) {
+        QByteArray hash;
+        const auto data = intern(bytes, hash);
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        if(it == m_data.end() || it->state == State::Committed) {
+            if(m_blobs)
+                m_blobs->release(hash);
+            return false;
+        }
+        it->data = data;
+        it->format = meta;
+        it->state = State::Committed;
+        it->stored = false;
+        it->hash = hash;
+        return true;
+    }
+
     QStringList keys() const {
-        MUTEX_LOCK(m_mutex);
+        READ_LOCK(m_lock);
         return m_data.keys();
     }
 
     void clean(bool clean_errors) {
-        MUTEX_LOCK(m_mutex);
+        WRITE_LOCK(m_lock);
         for(auto& e : m_data)
             if(e.state != State::Committed && (clean_errors || e.state != State::Error)) {
                 e.state = State::Empty;
@@ -110,33 +337,56 @@ public:
     }
 
     void clear(){
+        WRITE_LOCK(m_lock);
+        release(m_data);
         m_data.clear();
+        m_store.reset();
     }
 
     int size() const {
+        READ_LOCK(m_lock);
         return m_data.size();
     }
 
-    void write(QDataStream& stream) const {
-        const int size = std::accumulate(m_data.begin(), m_data.end(), 0, [](const auto &a, const auto& c){return c.state != State::Committed ? a : a + 1;});
-        stream << size;
-        const auto keys = m_data.keys();
-        for(const auto& key : keys) {
-            if(m_data[key].state == State::Committed) {
-                stream
-                        << key
-                        << m_data[key].url
-                        << m_data[key].data
-                        << m_data[key].format
-                        << m_data[key].state;
+    bool write(FigmaStore::Writer& writer, FigmaStore::Section section) const {
+        READ_LOCK(m_lock);
+        for(auto it = m_data.constBegin(); it != m_data.constEnd(); ++it) {
+            if(it->state != State::Committed)
+                continue;
+            if(it->stored) {
+                if(!writer.copy(section, it.key(), *m_store))
+                    return false;
+                continue;
             }
+            const auto bytes = it->hash.isEmpty() || !m_blobs ? std::make_optional(it->data) : m_blobs->get(it->hash);
+            if(bytes && !writer.add(section, it.key(), it->url, it->format, *bytes))
+                return false; // a lost spill is fetched again
+        }
+        return true;
+    }
+
+    // entries are loaded from the store on demand
+    void read(const std::shared_ptr<FigmaStore>& store, FigmaStore::Section section) {
+        const auto ids = store->ids(section);
+        QHash<QString, Entry> data;
+        data.reserve(ids.size());
+        for(const auto& id : ids) {
+            const auto e = store->entry(section, id);
+            data.insert(id, {e->url, {}, e->format, State::Committed, true});
         }
+        WRITE_LOCK(m_lock);
+        m_data.swap(data);
+        release(data);
+        m_store = store;
+        m_section = section;
     }
 
+    // FQ04 and older, everything in the stream
     void read(QDataStream& stream) {
         int size;
         stream >> size;
-        clear();
+        QHash<QString, Entry> data;
+        data.reserve(size);
         for(int i = 0; i < size; i++) {
             QString key;
             QString d1;
@@ -148,18 +398,81 @@ public:
             stream >> d2;
             stream >> format;
             stream >> state;
-            m_data.insert(key, {d1, d2, format, state});
+            QByteArray hash;
+            if(state == State::Committed)
+                d2 = intern(d2, hash);
+            data.insert(key, {d1, d2, format, state, false, hash});
         }
+        WRITE_LOCK(m_lock);
+        m_data.swap(data);
+        release(data);
+        m_store.reset();
     }
 private:
-    struct Data {
-        QString url;
+    std::optional<std::tuple<QByteArray, int>> load(const QString& key, const FigmaStore& store, FigmaStore::Section section) const {
+        // not locked, may take a while
+        const auto bytes = store.load(section, key);
+        QByteArray hash;
         QByteArray data;
-        int format;
-        State state;
-    };
-    QHash <QString, Data > m_data;
-    mutable QMutex m_mutex;
+        if(bytes) {
+            if(const auto e = store.entry(section, key))
+                hash = e->checksum; // verified on load
+            data = intern(*bytes, hash);
+        }
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        if(it == m_data.end() || it->state != State::Committed || !it->stored) {
+            if(bytes && m_blobs)
+                m_blobs->release(hash); // loaded meanwhile
+            if(!bytes || it == m_data.end() || it->state != State::Committed)
+                return std::nullopt;
+            return std::make_tuple(*bytes, it->format);
+        }
+        it->stored = false;
+        if(!bytes) {
+            qWarning() << store.errorString();
+            it->state = State::Empty; // fetched again
+            return std::nullopt;
+        }
+        it->data = data;
+        it->hash = hash;
+        return std::make_tuple(*bytes, it->format);
+    }
+
+    // a spilled payload that cannot be read back is fetched again
+    void lost(const QString& key, const QByteArray& hash) const {
+        WRITE_LOCK(m_lock);
+        const auto it = m_data.find(key);
+        if(it == m_data.end() || it->hash != hash)
+            return;
+        m_blobs->release(hash);
+        it->hash.clear();
+        it->state = State::Empty;
+    }
+
+    // what an entry keeps, nothing if held by m_blobs, hash is kept only for m_blobs
+    QByteArray intern(const QByteArray& bytes, QByteArray& hash) const {
+        if(!m_blobs) {
+            hash.clear();
+            return bytes;
+        }
+        m_blobs->intern(bytes, hash);
+        return {};
+    }
+
+    void release(const QHash<QString, Entry>& data) const {
+        if(!m_blobs)
+            return;
+        for(const auto& e : data)
+            if(!e.hash.isEmpty())
+                m_blobs->release(e.hash);
+    }
+private:
+    mutable QHash <QString, Entry> m_data; // stored entries are loaded on demand
+    mutable QReadWriteLock m_lock;
+    std::shared_ptr<FigmaStore> m_store;
+    FigmaStore::Section m_section = FigmaStore::Document;
+    std::shared_ptr<FigmaBlobs> m_blobs;
 };
 
 
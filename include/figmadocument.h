@@ -38,6 +38,7 @@ public:
         }
 
         virtual bool addElement(const QString& name, const QByteArray& data) = 0;
+        virtual bool setElement(int index, const QByteArray& data) = 0;
 
         int size() const {
             return static_cast<int>(m_elements.size());
@@ -108,10 +109,22 @@ public:
 
     void setComponents(const QString& name, const QStringList& components) {
         Q_ASSERT(!name.isEmpty());
-        if(m_componentMap.contains(name))
-            m_componentMap[name].unite(QSet<QString>(components.begin(), components.end()));
-        else
-            m_componentMap.insert(name, QSet<QString>(components.begin(), components.end()));
+        auto& direct = m_componentMap[name];
+        QSet<QString> added;
+        for(const auto& component : components) {
+            if(direct.contains(component))
+                continue;
+            direct.insert(component);
+            m_componentUsers[component].insert(name);
+            added.insert(component);
+            added.unite(m_componentClosure.value(component));
+        }
+        addToClosure(name, added);
+    }
+
+    // all components the given element or component depends on, sorted
+    QStringList components(const QString& name) const {
+        return m_componentList.value(name);
     }
 
 
@@ -119,11 +132,28 @@ public:
     virtual bool containsComponent(const QString& name) const = 0;
     virtual void addComponent(const QString& name, const QJsonObject& obj, const QByteArray& data) = 0;
 
+private:
+    // closure is kept up to date when a dependency is added, so that it is not re-walked on every query
+    void addToClosure(const QString& name, QSet<QString> added) {
+        auto& closure = m_componentClosure[name];
+        added.subtract(closure);
+        if(added.isEmpty())
+            return;
+        closure.unite(added);
+        auto& list = m_componentList[name];
+        list = closure.values();
+        list.sort();
+        for(const auto& user : m_componentUsers.value(name))
+            addToClosure(user, added);
+    }
 protected:
     const QString m_name;
     int m_current = 0;
     CanvasVector m_canvas;
-    QHash<QString, QSet<QString>> m_componentMap;
+    QHash<QString, QSet<QString>> m_componentMap;       // direct dependencies
+    QHash<QString, QSet<QString>> m_componentUsers;     // reverse of m_componentMap
+    QHash<QString, QSet<QString>> m_componentClosure;   // transitive dependencies
+    QHash<QString, QStringList> m_componentList;        // m_componentClosure sorted
 };
 
 enum class DocumentType {
@@ -132,37 +162,67 @@ enum class DocumentType {
 
 class FigmaFileDocument : public FigmaDocument {
     class CanvasFile : public FigmaDocument::Canvas {
+        // kept in memory until viewed, then the file has it
         class ElementFile : public FigmaDocument::Canvas::Element {
         public:
-            ElementFile(const QString& name, const QString& directory) : m_name(name), m_data((directory + name + ".qml").toLatin1()) {
+            ElementFile(const QString& name, const QString& directory, const QByteArray& content) :
+                m_name(name), m_data((directory + name + ".qml").toLatin1()), m_content(content) {
             }
-            bool bless(const QByteArray& data) {
-               QFile f(m_data);
-                if(f.exists()) {
-                   qDebug() << "Not replace" << m_name;
-                   return true;
+            bool bless(const QByteArray& content) {
+                if(!m_written) {
+                    m_content = content;
+                    return true;
                 }
-               if(!f.open(QIODevice::WriteOnly))
-                   return false;
-               f.write(data);
-               return true;
+                return write(content);
+            }
+            bool materialize() const {
+                if(m_written)
+                    return true;
+                if(!write(m_content))
+                    return false;
+                m_written = true;
+                m_content.clear();
+                return true;
             }
+            bool isWritten() const {return m_written;}
             QByteArray data() const override {return m_data;}
             QString name() const override {return m_name;}
+        private:
+            bool write(const QByteArray& content) const {
+               QFile f(m_data);
+               if(!f.open(QIODevice::WriteOnly))
+                   return false;
+               return f.write(content) == content.size();
+            }
         private:
             const QString m_name;
             const QByteArray m_data;
+            mutable QByteArray m_content;
+            mutable bool m_written = false;
         };
     public:
         explicit CanvasFile(const QString& name, const QString* directory) : Canvas(name), m_directory(directory) {}
         bool addElement(const QString& name, const QByteArray& data) override {
              Q_ASSERT(!name.isEmpty());
              Q_ASSERT(!data.isEmpty());
-             m_elements.push_back(std::make_unique<ElementFile>(name, *m_directory));
-             if(!reinterpret_cast<ElementFile*>(m_elements.back().get())->bless(data))
-                 return false;
+             m_elements.push_back(std::make_unique<ElementFile>(name, *m_directory, data));
              return true;
          }
+        bool setElement(int index, const QByteArray& data) override {
+             Q_ASSERT(index >= 0 && index < size());
+             Q_ASSERT(!data.isEmpty());
+             return static_cast<ElementFile*>(m_elements[index].get())->bless(data);
+         }
+        bool materialize(int index) const {
+             Q_ASSERT(index >= 0 && index < size());
+             return static_cast<const ElementFile*>(m_elements[index].get())->materialize();
+        }
+        void removeFiles() const {
+             for(const auto& e : m_elements) {
+                 if(static_cast<const ElementFile*>(e.get())->isWritten())
+                     QFile::remove(e->data());
+             }
+        }
     private:
         const QString* m_directory;
     };
@@ -172,11 +232,13 @@ public:
      }
 
      ~FigmaFileDocument() {
-         for(const auto& c : *this) {
-             for(const auto& e : *c) {
-                 QFile::remove(e->data());
-             }
-         }
+         for(const auto& c : *this)
+             static_cast<const CanvasFile*>(c.get())->removeFiles();
+     }
+
+     // the file of the current element is written when it is first asked for
+     bool materialize() const {
+         return static_cast<const CanvasFile&>(current()).materialize(current().currentIndex());
      }
 
      bool containsComponent(const QString& name) const override {
@@ -206,9 +268,10 @@ class FigmaDataDocument : public FigmaDocument {
             ElementData(const QString& name, const QByteArray& data) : m_name(name), m_data(data) {}
             QByteArray data() const override {return m_data;}
             QString name() const override {return m_name;}
+            void setData(const QByteArray& data) {m_data = data;}
         private:
             const QString m_name;
-            const QByteArray m_data;
+            QByteArray m_data;
         };
     public:
         explicit CanvasData(const QString& name) : Canvas(name) {}
@@ -218,6 +281,12 @@ class FigmaDataDocument : public FigmaDocument {
              m_elements.push_back(std::make_unique<ElementData>(name, data));
              return true;
          }
+        bool setElement(int index, const QByteArray& data) override {
+             Q_ASSERT(index >= 0 && index < size());
+             Q_ASSERT(!data.isEmpty());
+             static_cast<ElementData*>(m_elements[index].get())->setData(data);
+             return true;
+         }
     };
 public:
     static DocumentType type() {return DocumentType::DataDocument;}
@@ -225,14 +294,6 @@ public:
         Q_UNUSED(directory);
     }
 
-    QStringList components(const QString& elementName) const {
-        QSet<QString> allComponents;
-        getComponents(allComponents, elementName);
-        QStringList lst = allComponents.values();
-        lst.sort();
-        return lst;
-    }
-
     Canvas* addCanvas(const QString& canvasName) override {
         m_canvas.push_back(std::make_unique<CanvasData>(canvasName));
         return m_canvas.back().get();
@@ -324,15 +385,6 @@ public:
         return m_components[componentName].second;
     }
 
-private:
-    void getComponents(QSet<QString>& componentSet, const QString& elementName) const {
-        for(const QString& component : m_componentMap[elementName]) {
-            if(!componentSet.contains(component)){
-                componentSet.insert(component);
-                getComponents(componentSet, component);
-            }
-        }
-    }
 private:
     QHash<QString, QPair<QByteArray, QByteArray>> m_components;
 };
@@ -2,17 +2,28 @@
 #define FIGMAGET_H
 
 #include "figmaprovider.h"
+#include "downloads.h"
+#include "figmastore.h"
 #include <QTime>
 #include <QMutex>
 #include <QTimer>
 #include <QQueue>
+#include <QMap>
+#include <QSet>
+#include <QJsonObject>
 #include <QNetworkReply>
+#include <QElapsedTimer>
 #include <memory>
 
 class FigmaData;
-class Downloads;
+class FigmaBlobs;
 class Timeout;
 class Execute;
+class RequestScheduler;
+class QTemporaryFile;
+class QThreadPool;
+class TrafficRecorder;
+class AssetCache;
 
 class FigmaGet : public FigmaProvider {
     Q_OBJECT
@@ -20,6 +31,11 @@ class FigmaGet : public FigmaProvider {
     Q_PROPERTY(QString userToken MEMBER m_userToken NOTIFY userTokenChanged)
     Q_PROPERTY(QString projectToken MEMBER m_projectToken NOTIFY projectTokenChanged)
     Q_PROPERTY(int throttle MEMBER m_throttle NOTIFY throttleChanged)
+    Q_PROPERTY(int concurrency MEMBER m_concurrency NOTIFY concurrencyChanged)
+    Q_PROPERTY(int memoryBudget MEMBER m_memoryBudget NOTIFY memoryBudgetChanged)
+    Q_PROPERTY(int assetCacheSize MEMBER m_assetCacheSize NOTIFY assetCacheSizeChanged)
+    Q_PROPERTY(QString apiUrl MEMBER m_apiUrl NOTIFY apiUrlChanged)
+    Q_PROPERTY(QVariantMap renderingStats READ renderingStats NOTIFY renderingStatsChanged)
     using NetworkFunction = std::function <QNetworkReply* ()>;
 public:
     enum class IdType {IMAGE, RENDERING, NODE};
@@ -27,6 +43,7 @@ public:
     explicit FigmaGet(QObject *parent = nullptr);
     ~FigmaGet();
     Q_INVOKABLE void update();
+    void setScope(const QMap<int, QSet<int>>& scope);
 
     void getImage(const QString& imageRef,
                                         const QSize& maxSize = QSize(std::numeric_limits<int>::max(),
@@ -34,10 +51,14 @@ public:
     void getRendering(const QString& figmaId) override;
     void getNode(const QString& figmaId) override;
     QByteArray data() const;
+    QByteArray document() const;
+    QVariantMap renderingStats() const;
 
     Downloads* downloadProgress();
     Q_INVOKABLE bool store(const QString& filename, unsigned flag, const QVariantMap& imports);
     Q_INVOKABLE bool restore(const QString& filename);
+    bool record(const QString& dirName);
+    bool replay(const QString& dirName);
 public:
     std::optional<std::tuple<QByteArray, int>> cachedImage(const QString& imageRef) override;
     std::optional<std::tuple<QByteArray, int>> cachedRendering(const QString& figmaId) override;
@@ -61,59 +82,103 @@ signals:
     void userTokenChanged();
     void updateCompleted(bool isUpdated);
     void throttleChanged();
+    void memoryBudgetChanged();
+    void assetCacheSizeChanged();
+    void concurrencyChanged();
+    void apiUrlChanged();
+    void renderingStatsChanged();
     void restored(unsigned flags, const QVariantMap& imports);
-    void replyComplete(const std::shared_ptr<QByteArray>& bytes);
+    void replyComplete(const std::shared_ptr<QByteArray>& bytes, const QString& version);
 private:
     struct Id {
         bool isEmpty() const {return id.isEmpty();}
         const QString id; const IdType type;
     };
     using FinishedFunction = std::function<void ()>;
+    using FailedFunction = std::function<void (const QString& reason)>;
+    // state of a reply in flight, each reply routes its own signals here
+    struct Request {
+        std::shared_ptr<QByteArray> bytes;
+        FinishedFunction finished;
+        std::shared_ptr<QTemporaryFile> stream; // if set, body is written there instead of bytes
+        QElapsedTimer elapsed;
+        FailedFunction failed;  // if set, an HTTP error is handled there instead of failing the fetch
+    };
     void monitorReply(QNetworkReply* reply, const std::shared_ptr<QByteArray>& bytes,
-                      const FinishedFunction& finalize, bool showProgress = true);
-    void queueCall(const NetworkFunction& call);
+                      const FinishedFunction& finalize, Downloads::Category category, bool showProgress = true,
+                      const std::shared_ptr<QTemporaryFile>& stream = nullptr);
+    bool readReply(QNetworkReply* reply);
+    void onReplyError(QNetworkReply* reply, QNetworkReply::NetworkError err);
+    void recordReply(QNetworkReply* reply, const Request& request);
+    void queueCall(const NetworkFunction& call, bool isApiCall = true);
     QByteArray image(const Id& imageRef, const QByteArray& imageData) const;
-    bool write(QDataStream& stream, unsigned flag, const QVariantMap& imports) const;
+    bool write(FigmaStore::Writer& writer) const;
+    bool read(const std::shared_ptr<FigmaStore>& store);
     bool read(QDataStream& stream);
 private slots:
-     void replyCompleted(const std::shared_ptr<QByteArray>& bytes);
-     void doCall();
+     void replyCompleted(const std::shared_ptr<QByteArray>& bytes, const QString& version);
      void doFinished(QNetworkReply* reply);
-     void onReplyError(QNetworkReply::NetworkError err);
-     void replyReader();
      void onRetrievedImage(const QString& imageRef);
      void onRetrievedNode(const QString& nodeId);
 private:
     QNetworkReply* populateImages();
-    QNetworkReply* doRequestRendering(const Id& id);
-    void doRetrieveNode(const Id& id);
+    void fetchDocument(const QString& version);
+    struct ScopedFetch;
+    void fetchScoped(const QJsonObject& skeleton, const QString& version);
+    QNetworkReply* doFetchScoped(const std::shared_ptr<ScopedFetch>& fetch, const QStringList& ids);
+    QNetworkReply* doRequestRendering();
+    void retryRenderings(const QStringList& ids, const QString& reason);
+    void addRenderingStats(int ids, qint64 ms);
+    QNetworkReply* doRetrieveNodes(QStringList& batch);
     QNetworkReply* doRetrieveImage(const Id& id,  FigmaData* target, const QSize& maxSize);
     void retrieveImage(const Id& id,  FigmaData* target, const QSize& maxSize = QSize(std::numeric_limits<int>::max(), std::numeric_limits<int>::max()));
     void requestRendering(const Id& imageId);
-    void retrieveNode(const Id& id);
+    void retrieveNodes();
     void setError(const Id& imageRef, const QString& reason);
-    void setTimeout(const std::shared_ptr<QMetaObject::Connection>& connection, const Id& id);
-    void setTimeout(QNetworkReply* reply, const Id& id);
+    QString markError(const Id& imageRef);
+    void timedOut(const Id& imageRef);
+    void setImage(const Id& id, FigmaData* target, const QByteArray& bytes, int format);
+    QString assetKey(const Id& id, const QSize& maxSize) const;
+    bool fromAssetCache(const Id& id, FigmaData* target, const QSize& maxSize);
+    void toAssetCache(const Id& id, const QSize& maxSize, const QByteArray& bytes, int format);
+    void updateAssetCache();
+    void setTimeout(QNetworkReply* reply, IdType type, const QStringList& ids, const FinishedFunction& expired = nullptr);
 private:
     enum class State {Loading, Complete, Error};
     QNetworkAccessManager* m_accessManager;
     Timeout* m_timeout;
     Execute* m_error;
     Downloads* m_downloads;
+    RequestScheduler* m_scheduler;
+    QThreadPool* m_imagePool;
+    std::unique_ptr<TrafficRecorder> m_recorder;
+    std::unique_ptr<AssetCache> m_assetCache;
+    int m_resizing = 0; // images being resized in m_imagePool
     QString m_projectToken;
     QString m_userToken;
     QByteArray m_data;
-    unsigned m_checksum = 0;
+    QString m_version; // Figma file version of m_data
+    QMap<int, QSet<int>> m_scope;      // pages and their elements (1-based) to fetch, empty means all
+    QMap<int, QSet<int>> m_dataScope;  // scope of m_data
+    std::shared_ptr<FigmaBlobs> m_blobs; // images and renderings by content
     std::unique_ptr<FigmaData> m_images;
     std::unique_ptr<FigmaData> m_renderings;
     std::unique_ptr<FigmaData> m_nodes;
+    std::shared_ptr<FigmaStore> m_store; // restored from, entries are loaded from there
     std::atomic_bool m_populationOngoing = false;
-    int m_throttle = 300; //Idea of throttle is collect requests into queue and bunches to reduce especially renderig requests
-    QQueue<NetworkFunction> m_callQueue;
-    QTimer m_callTimer;
+    int m_throttle = 300; // milliseconds per API request on average, requests are also collected into bunches, especially renderig requests
+    int m_concurrency = 6;
+    int m_memoryBudget = 512; // MB of images and renderings kept in memory, the rest is spilled to disk, 0 is no limit
+    int m_assetCacheSize = 1024; // MB of the machine wide AssetCache, 0 does not use it
+    QString m_apiUrl = "https://api.figma.com/v1/";
     QStringList m_rendringQueue;
+    QStringList m_nodeQueue;
+    QHash<QString, int> m_renderingRetries;
+    QVariantMap m_renderingStats; // per chunk latencies
     State m_connectionState = State::Loading;
-    QMap<QNetworkReply*, std::tuple<std::shared_ptr<QByteArray>, FinishedFunction>> m_replies;
+    QHash<QNetworkReply*, Request> m_replies;
+    std::shared_ptr<QTemporaryFile> m_receivedFile;     // mapped document waiting for replyCompleted
+    std::shared_ptr<QTemporaryFile> m_documentFile;     // m_data is mapped from here, see document()
     std::function<void (const QString&)> m_lastError = nullptr;
 };
 
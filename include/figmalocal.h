@@ -0,0 +1,67 @@
+#ifndef FIGMALOCAL_H
+#define FIGMALOCAL_H
+
+#include "figmaprovider.h"
+#include <QVariantMap>
+#include <memory>
+
+class FigmaData;
+
+/**
+ * @brief The FigmaLocal class serves a document, its images, renderings and nodes without network,
+ * either from a .figmaqml file, from a directory recorded with '--record' or from a capture directory:
+ *      document.json
+ *      images/<imageRef>
+ *      renderings/<figmaId>
+ *      nodes/<figmaId>.json
+ * where ids are percent encoded. A capture is keyed by ids so it can be written by hand or by other
+ * tools, a recording is keyed by request urls and is mapped to ids as FigmaGet does with the responses.
+ * Each request is answered after latency milliseconds, so conversions can be benchmarked repeatably.
+ */
+class FigmaLocal : public FigmaProvider {
+    Q_OBJECT
+    Q_PROPERTY(int latency MEMBER m_latency NOTIFY latencyChanged)
+public:
+    explicit FigmaLocal(QObject* parent = nullptr);
+    ~FigmaLocal();
+    bool restore(const QString& path);
+    QByteArray data() const;
+    static QString fileName(const QString& id);
+public:
+    bool isReady() override;
+    std::optional<std::tuple<QByteArray, int>> cachedImage(const QString& imageRef) override;
+    std::optional<std::tuple<QByteArray, int>> cachedRendering(const QString& figmaId) override;
+    std::optional<QByteArray> cachedNode(const QString& figmaId) override;
+    void getImage(const QString& imageRef,
+                  const QSize& maxSize = QSize(std::numeric_limits<int>::max(),
+                                               std::numeric_limits<int>::max())) override;
+    void getRendering(const QString& figmaId) override;
+    void getNode(const QString& figmaId) override;
+    std::tuple<int, int, int> cacheInfo() const override;
+public slots:
+    void reset() override;
+signals:
+    void error(const QString& errorString);
+    void latencyChanged();
+    void restored(unsigned flags, const QVariantMap& imports); // imports are empty for a directory
+private:
+    enum class Kind {Image, Rendering, Node};
+    std::optional<std::tuple<QByteArray, int>> load(Kind kind, const QString& id) const;
+    bool get(Kind kind, const QString& id, FigmaData* cache);
+    bool readArchive(const QString& filename);
+    bool readRecording(const QString& dirName);
+    static int imageFormat(QByteArray& bytes);
+private:
+    QString m_path;     // capture directory, empty if an archive or a recording
+    QByteArray m_data;
+    std::unique_ptr<FigmaData> m_archiveImages;
+    std::unique_ptr<FigmaData> m_archiveRenderings;
+    std::unique_ptr<FigmaData> m_archiveNodes;
+    std::unique_ptr<FigmaData> m_images;    // delivered so far
+    std::unique_ptr<FigmaData> m_renderings;
+    std::unique_ptr<FigmaData> m_nodes;
+    int m_latency = 0;
+    int m_pending = 0;
+};
+
+#endif // FIGMALOCAL_H
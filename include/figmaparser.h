@@ -61,6 +61,17 @@ public:
         const QByteArray m_color;
         const ElementVector m_elements;
     };
+    /**
+     * @brief The Node struct, what a search can find from a parsed node
+     */
+    struct Node {
+        QString id;
+        QString name;
+        QString characters; // text content
+        QString component;  // name of the component an instance is of
+        QString imageRef;
+    };
+    using Nodes = QVector<Node>;
     /**
      * @brief The Element class, an element on page - converted to QML file
      */
@@ -74,9 +85,11 @@ public:
                 QStringList&& contexts,
                 QVector<QString>&& aliases,
                 const ComponentStreams& componentStreams,
-                const ExternalLoaders& externalLoaders) :
+                const ExternalLoaders& externalLoaders,
+                Nodes&& nodes) :
             m_name(name), m_id(id), m_type(type), m_data(data), m_componentIds(componentIds),
-            m_imageContexts{contexts}, m_aliases(aliases), m_componentStreams(componentStreams), m_externalLoaders(externalLoaders) {}
+            m_imageContexts{contexts}, m_aliases(aliases), m_componentStreams(componentStreams), m_externalLoaders(externalLoaders),
+            m_nodes(nodes) {}
         Element() {}
         Element(const Element& other) = default;
         Element& operator=(const Element& other) = delete;
@@ -88,6 +101,7 @@ public:
         const QVector<QString>& aliases() const {return m_aliases;}
         const ComponentStreams& subComponents() const {return m_componentStreams;}
         const ExternalLoaders& externalLoaders() const {return m_externalLoaders;}
+        const Nodes& nodes() const {return m_nodes;}
     private:
         const QString m_name;
         const QString m_id;
@@ -98,6 +112,7 @@ public:
         const QVector<QString> m_aliases;
         const ComponentStreams m_componentStreams;
         const ExternalLoaders m_externalLoaders;
+        const Nodes m_nodes;
     };
     /**
      * @brief The Component class, Figma component, an element can compose and/or override parts with components.
@@ -153,10 +168,12 @@ public:
     static std::optional<Components> components(const QJsonObject& project,  FigmaParserData& data);
     static std::optional<Canvases> canvases(const QJsonObject& project);
     static std::optional<Element> component(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const Components& components);
-    static std::optional<Element> element(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const Components& components);
+    static std::optional<Element> element(const QJsonObject& obj, unsigned flags,  FigmaParserData& data, const Components& components, const QString& elementName = QString());
+    static QString elementName(const QJsonObject& obj);
     static QString name(const QJsonObject& project);
     static QString lastError();
     static QString makeFileName(const QString& itemName);
+    static QByteArray qmlId(const QString& figmaId);
 private:
     enum class StrokeType {Normal, Double, OnePix};
     enum class ItemType {None, Vector, Text, Frame, Component, Boolean, Instance};
@@ -167,7 +184,7 @@ private:
                              const QSet<QString>& ignored,
                              const QHash<QString, std::function<QJsonValue (const QJsonValue&, const QJsonValue&)>>& compares);
     static QHash<QString, QString> children(const QJsonObject& obj);
-    std::optional<Element> getElement(const QJsonObject& obj);
+    std::optional<Element> getElement(const QJsonObject& obj, const QString& elementName = QString());
     QString tabs(int indents) const;
 #if 0
     QRectF boundingRect(const QJsonObject& obj);
@@ -176,6 +193,7 @@ private:
     static QByteArray toColor(double r, double g, double b, double a = 1.0);
     QByteArray makeId(const QJsonObject& obj);
     QByteArray makeId(const QString& prefix,  const QJsonObject& obj);
+    void addNode(const QJsonObject& obj);
     EByteArray makeComponentInstance(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver = QByteArray());
     EByteArray makeItem(const QString& type, const QJsonObject& obj, int indents, const QByteArray& change_receiver = QByteArray());
 
@@ -319,6 +337,8 @@ private:
     static QByteArray fontWeight(double v);
     static std::optional<FigmaParser::ItemType> type(const QJsonObject& obj);
     ExternalLoaders m_externalLoaders;
+    Nodes m_nodes;
+    QSet<QString> m_nodeIds; // a node can be parsed more than once
 };
 
 #endif // FIGMAPARSER_H
@@ -4,6 +4,9 @@
 #include "figmadocument.h"
 #include "figmaprovider.h"
 #include "figmaparser.h"
+#include "generationqueue.h"
+#include "elementmodel.h"
+#include "searchindex.h"
 #include <QObject>
 #include <QVariantMap>
 #include <QUrl>
@@ -39,7 +42,7 @@ class FigmaQml : public QObject, public FigmaParserData {
     Q_PROPERTY(QVariantMap fonts READ fonts WRITE setFonts NOTIFY fontsChanged STORED false)
     Q_PROPERTY(QString fontFolder MEMBER m_fontFolder NOTIFY fontFolderChanged)
     Q_PROPERTY(QString documentsLocation READ documentsLocation CONSTANT)
-    Q_PROPERTY(QVariantList elements READ elements NOTIFY elementsChanged)
+    Q_PROPERTY(ElementModel* elements READ elements CONSTANT)
     Q_PROPERTY(QStringList supportedQulHardware READ supportedQulHardware CONSTANT)
 public:
     enum Flags { // WARNING these map values are (partly) same with figmaparser flags
@@ -93,12 +96,13 @@ public:
     void setFilter(const QMap<int, QSet<int>>& filter);
     void restore(int flags, const QVariantMap& imports);
     QString documentsLocation() const;
-    QVariantList elements() const;
+    ElementModel* elements() const;
     const auto& externalLoaders() const {return m_externalLoaders;}
     QStringList supportedQulHardware() const;
     Q_INVOKABLE bool saveAllQML(const QString& folderName);
     Q_INVOKABLE bool saveQML(bool asMcu, const QString& folderName, bool writeAsApp, const QVector<int>& elements);
     Q_INVOKABLE void cancel();
+    Q_INVOKABLE bool saveTrace(const QString& fileName) const;
     Q_INVOKABLE static QString validFileName(const QString& name);
     Q_INVOKABLE QByteArray componentSourceCode(const QString& name) const;
     Q_INVOKABLE QString componentObject(const QString& name) const;
@@ -113,6 +117,7 @@ public:
     Q_INVOKABLE void executeApp(const QVariantMap& parameters, const QVector<int>& elements);
     Q_INVOKABLE bool hasFontPathInfo() const;
     Q_INVOKABLE void findFontPath(const QString& fontFamilyName) const;
+    Q_INVOKABLE QVariantList find(const QString& text, int max = 100) const;
 #ifdef USE_NATIVE_FONT_DIALOG
     // sigh font native dialog wont work on WASM and QML dialog is buggy
     Q_INVOKABLE void showFontDialog(const QString& currentFont);
@@ -135,6 +140,7 @@ signals:
     void figmaDocumentCreated(FigmaFileDocument* doc);
     void figmaDocumentCreated(FigmaDataDocument* doc);
     void documentCreated();
+    void documentCompleted();
     void sourceCodeChanged();
     void elementChanged();
     void flagsChanged();
@@ -164,7 +170,6 @@ signals:
     void fontLoaded(const QFont& font);
     void fontPathFound(const QString& fontPath);
     void fontPathError(const QString& error);
-    void elementsChanged();
     void externalLoadersApplied(const QString& name, const QString& source);
 #ifdef USE_NATIVE_FONT_DIALOG
     void fontAdded(const QString& fontFamilyName);
@@ -178,18 +183,27 @@ private slots:
     void updateDefaultImports();
     void applyExternalLoaders();
 private:
+    class Generation;
     void addImageFile(const QString& imageRef, bool isRendering);
     bool addImageFileData(const QString& imageRef, const QByteArray& bytes, int mime);
     bool ensureDirExists(const QString& dirname) const;
-    bool doCreateDocument(FigmaDocument& doc, const QJsonObject& json);
     template<class FigmaDocType>
-    void createDocument(const QJsonObject& json);
+    void createDocument(const QJsonObject& json, const std::optional<GenerationQueue::Index>& focus);
+    void createSources(const QJsonObject& json, const std::optional<GenerationQueue::Index>& focus);
+    void generate(std::unique_ptr<Generation>& generation);
+    bool prepareGeneration(Generation& generation);
+    bool generateNext(Generation& generation);
+    bool generateComponent(Generation& generation, const QString& id);
+    bool generateElement(Generation& generation, const GenerationQueue::Index& index);
+    void addSearchHits(const QString& name, const QByteArray& header, const GenerationQueue::Index& index, const FigmaParser::Element& parsed);
+    void stopGenerations();
+    void endGeneration(std::unique_ptr<Generation>& generation);
+    void refocus();
     std::optional<QJsonObject> object(const QByteArray& bytes);
     void cleanDir(const QString& dirName);
     std::optional<std::tuple<QByteArray, int>> getImage(const QString& imageRef, bool isRendering);
     void suspend();
-    bool writeComponents(FigmaDocument& doc, const FigmaParser::Components& components, const QByteArray& header);
-    bool setDocument(FigmaDocument& doc, const FigmaParser::Canvases& canvases, const FigmaParser::Components& components, const QByteArray& header);
+    bool isAwaited(Generation& generation);
     QString qmlTargetDir() const override;
     std::optional<QString> uniqueFilename(const QString& filename, const QByteArray& data);
 private:
@@ -197,6 +211,8 @@ private:
     FigmaProvider& mProvider;
     std::unique_ptr<FigmaFileDocument> m_uiDoc;
     std::unique_ptr<FigmaDataDocument> m_sourceDoc;
+    std::unique_ptr<Generation> m_viewGeneration;
+    std::unique_ptr<Generation> m_sourceGeneration;
     QVariantMap m_imports;
     int m_imageDimensionMax = 1024;
     bool m_busy = false;
@@ -204,20 +220,20 @@ private:
     QByteArray m_brokenPlaceholder;
     QMap<int, QSet<int>> m_filter;
     QHash<QString, QPair<QString, QString>> m_imageFiles;
+    QHash<QByteArray, QString> m_imageHashes; // content -> file name in m_imageFiles
     QString m_snap;
     std::unique_ptr<FontCache> m_fontCache;
     QString m_fontFolder;
-    std::atomic_bool m_doCancel = false;    
-    std::atomic_bool m_ok = true;
     bool m_embedImages = false;
-    enum class State {Constructing, Failed, Suspend};
-    State m_state = State::Constructing;
+    Generation* m_generation = nullptr; // the one being generated now, parser callbacks refer to it
     std::function<void (bool)> mRestore = nullptr;
     QHash<QString, QSet<QString>> m_imageContexts;
     FontInfo* m_fontInfo;
+    ElementModel* m_elements;
     FigmaParser::ExternalLoaders m_externalLoaders;
     unsigned m_unique_number = 1;
     QHash<QString, quint16> m_crcs;
+    SearchIndex m_search; // built with the sources
 };
 
 
@@ -0,0 +1,101 @@
+#ifndef FIGMASTORE_H
+#define FIGMASTORE_H
+
+#include <QFile>
+#include <QSaveFile>
+#include <QHash>
+#include <QMutex>
+#include <QVariantMap>
+#include <optional>
+#include <array>
+#include <functional>
+
+class QDataStream;
+
+/**
+ * @brief The FigmaStore class reads and writes the indexed .figmaqml container:
+ *      "FQ05"
+ *      entries, JSON zlib compressed, images as they are
+ *      index, compressed, meta data and where each entry is
+ *      index offset (quint64) "FQ05"
+ * Only the index is read on open, entries are read and their checksum verified when loaded.
+ * An update appends changed entries, a new index and a trailer, entries and indices left behind
+ * are superseded until the store is compacted.
+ */
+class FigmaStore {
+public:
+    enum Section {Document, Images, Renderings, Nodes, SectionCount};
+    struct Meta {
+        QString projectToken;
+        QString version;
+        unsigned flags = 0;
+        QVariantMap imports;
+    };
+    struct Entry {
+        QString url;
+        int format;
+        qint64 offset;
+        qint64 storedSize;
+        qint64 size;
+        bool compressed;
+        QByteArray checksum;
+    };
+    class Writer;
+public:
+    static bool isStore(const QString& filename);
+    static QByteArray checksum(const QByteArray& bytes);
+    static std::optional<Meta> readLegacy(QDataStream& stream, QByteArray& document);
+    bool open(const QString& filename);
+    void close();
+    bool isOpen() const;
+    QString fileName() const;
+    QString errorString() const;
+    Meta meta() const;
+    QStringList ids(Section section) const;
+    std::optional<Entry> entry(Section section, const QString& id) const;
+    std::optional<QByteArray> load(Section section, const QString& id) const;
+    qint64 superseded() const;
+    bool update(const std::function<bool ()>& write);
+    bool compact();
+private:
+    bool openLocked(const QString& filename);
+    void closeLocked();
+    std::optional<Entry> entryLocked(Section section, const QString& id) const;
+    bool readStored(const Entry& entry, QByteArray& bytes) const;
+    bool readStoredLocked(const Entry& entry, QByteArray& bytes) const;
+private:
+    mutable QFile m_file;
+    mutable QMutex m_mutex; // entries are loaded from any thread, also while the file is updated
+    mutable QString m_errorString;
+    Meta m_meta;
+    qint64 m_indexOffset = 0;
+    std::array<QHash<QString, Entry>, SectionCount> m_index;
+};
+
+/**
+ * @brief The FigmaStore::Writer class writes a new container, the file is replaced only on commit,
+ * or appends to an existing one. Bytes already in the file are not written again, entries of
+ * identical content refer to the same location.
+ */
+class FigmaStore::Writer {
+public:
+    enum class Mode {Replace, Append};
+    explicit Writer(const QString& filename, Mode mode = Mode::Replace);
+    ~Writer();
+    bool add(Section section, const QString& id, const QString& url, int format, const QByteArray& bytes);
+    bool copy(Section section, const QString& id, const FigmaStore& from);
+    bool commit(const Meta& meta);
+    QString errorString() const;
+private:
+    bool append(Section section, const QString& id, const Entry& entry, const QByteArray& stored);
+    bool reuse(Section section, const QString& id, const QByteArray& sum, const QString& url, int format);
+private:
+    QSaveFile m_saveFile;
+    QFile m_appendFile;
+    QFileDevice* m_file;
+    qint64 m_appendFrom = 0;  // size before append, restored if it fails
+    std::array<QHash<QString, Entry>, SectionCount> m_index;
+    QHash<QByteArray, Entry> m_blobs; // checksum -> where those bytes are already written
+};
+
+#endif // FIGMASTORE_H
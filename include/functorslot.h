@@ -4,7 +4,11 @@
 #include <QObject>
 #include <QTimer>
 #include <QHash>
+#include <QVector>
+#include <QElapsedTimer>
 #include <QDebug>
+#include <algorithm>
+#include <functional>
 
 class Execute : public QObject {
     Q_OBJECT
@@ -17,50 +21,103 @@ private:
     std::function<void ()> mFn = nullptr;
 };
 
+/**
+ * @brief The Timeout class keeps timeouts on a hashed timer wheel. A single timer ticks
+ * through the slots and an entry expires when its slot is reached on its last round,
+ * set and cancel are O(1) regardless how many timeouts are pending.
+ */
 class Timeout : public QObject {
     Q_OBJECT
 public:
-    explicit Timeout(QObject* parent = nullptr) : QObject(parent) {}
+    static constexpr int TickMs = 250;
+    static constexpr int WheelSize = 256; // a round is 64s
+
+    explicit Timeout(QObject* parent = nullptr) : QObject(parent), mSlots(WheelSize) {
+        mTimer.setInterval(TickMs);
+        mTimer.setTimerType(Qt::CoarseTimer);
+        QObject::connect(&mTimer, &QTimer::timeout, this, &Timeout::tick);
+    }
 
     int pending() const {
-        return mTimers.size();
+        return mEntries.size();
     }
 
     void set(const QString& id, int ms, const std::function<void ()>& fn) {
-        Q_ASSERT(!mTimers.contains(id));
+        Q_ASSERT(!mEntries.contains(id));
         Q_ASSERT(fn);
-        auto t = new QTimer(this);
-        mTimers.insert(id, {fn, t});
-        t->setSingleShot(true);
-        t->start(ms);
-        QObject::connect(t, &QTimer::timeout, this, [this, id]() {
-            qDebug() << "Timeout" << id;
-            auto t = std::get<QTimer*>(mTimers[id]);
-            t->deleteLater();
-            mTimers.remove(id);
-        });
+        if(!mTimer.isActive()) {
+            if(!mElapsed.isValid())
+                mElapsed.start();
+            mTicks = mElapsed.elapsed() / TickMs; // idle time is not caught up
+            mTimer.start();
+        }
+        const auto ticks = std::max(1, (ms + TickMs - 1) / TickMs);
+        const auto slot = (mCursor + ticks) % WheelSize;
+        mSlots[slot].insert(id, {fn, (ticks - 1) / WheelSize});
+        mEntries.insert(id, slot);
     }
 
     void cancel(const QString& id) {
-        Q_ASSERT(mTimers.contains(id));
-        auto t = std::get<QTimer*>(mTimers[id]);
-        t->stop();
-        t->deleteLater();
-        mTimers.remove(id);
-        if(mTimers.isEmpty())
+        const auto it = mEntries.find(id);
+        if(it == mEntries.end())
+            return; // already expired
+        mSlots[*it].remove(id);
+        mEntries.erase(it);
+        if(mEntries.isEmpty()) {
+            mTimer.stop();
             emit purged();
+        }
     }
 
     void reset() {
-        const auto keys = mTimers.keys();
-        for(const auto& k : keys) {
-            cancel(k);
-        }
+        if(mEntries.isEmpty())
+            return;
+        for(auto& slot : mSlots)
+            slot.clear();
+        mEntries.clear();
+        mTimer.stop();
+        emit purged();
     }
 signals:
     void purged();
 private:
-    QHash<QString, std::tuple<std::function<void ()>, QTimer*>> mTimers;
+    void tick() {
+        // catch up if the event loop has been blocked over several ticks
+        const auto due = mElapsed.elapsed() / TickMs;
+        for(; mTicks < due && !mEntries.isEmpty(); ++mTicks) {
+            mCursor = (mCursor + 1) % WheelSize;
+            auto& slot = mSlots[mCursor];
+            QVector<std::function<void ()>> expired;
+            for(auto it = slot.begin(); it != slot.end();) {
+                if(it->rounds > 0) {
+                    --it->rounds;
+                    ++it;
+                    continue;
+                }
+                qDebug() << "Timeout" << it.key();
+                expired.append(it->fn);
+                mEntries.remove(it.key());
+                it = slot.erase(it);
+            }
+            for(const auto& fn : expired)
+                fn(); // may set or cancel other timeouts
+        }
+        if(mEntries.isEmpty() && mTimer.isActive()) {
+            mTimer.stop();
+            emit purged();
+        }
+    }
+private:
+    struct Entry {
+        std::function<void ()> fn;
+        int rounds;
+    };
+    QTimer mTimer;
+    QElapsedTimer mElapsed;
+    qint64 mTicks = 0;
+    int mCursor = 0;
+    QVector<QHash<QString, Entry>> mSlots;
+    QHash<QString, int> mEntries; // id -> slot
 };
 
 
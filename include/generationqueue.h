@@ -0,0 +1,91 @@
+#ifndef GENERATIONQUEUE_H
+#define GENERATIONQUEUE_H
+
+#include <QPair>
+#include <QSet>
+#include <QVector>
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+
+/**
+ * @brief The GenerationQueue class keeps elements waiting for the generation.
+ * Element in focus comes first, then its neighbours in the same canvas and
+ * then the rest, nearest canvases first.
+ */
+class GenerationQueue {
+public:
+    using Index = QPair<int, int>; // canvas, element
+
+    explicit GenerationQueue(const Index& focus = {0, 0}) : m_focus(focus) {}
+
+    void insert(const Index& index) {
+        m_pending.insert(index);
+        m_dirty = true;
+    }
+
+    void remove(const Index& index) {
+        m_pending.remove(index); // m_order is cleaned up lazily in next()
+    }
+
+    bool contains(const Index& index) const {
+        return m_pending.contains(index);
+    }
+
+    bool isEmpty() const {
+        return m_pending.isEmpty();
+    }
+
+    int size() const {
+        return m_pending.size();
+    }
+
+    const QSet<Index>& pending() const {
+        return m_pending;
+    }
+
+    Index focus() const {
+        return m_focus;
+    }
+
+    void setFocus(const Index& focus) {
+        if(focus != m_focus) {
+            m_focus = focus;
+            m_dirty = true;
+        }
+    }
+
+    // the most urgent pending element, queue must not be empty
+    Index next() {
+        Q_ASSERT(!isEmpty());
+        if(m_dirty)
+            sort();
+        while(!m_pending.contains(m_order.back()))
+            m_order.removeLast();
+        return m_order.back();
+    }
+
+private:
+    auto priority(const Index& index) const {
+        const auto canvasDistance = std::abs(index.first - m_focus.first);
+        const auto elementDistance = canvasDistance == 0 ? std::abs(index.second - m_focus.second) : index.second;
+        return std::make_tuple(canvasDistance, elementDistance, index.first, index.second);
+    }
+
+    void sort() {
+        m_order = QVector<Index>(m_pending.begin(), m_pending.end());
+        // reversed so that the most urgent is the last and can be popped cheaply
+        std::sort(m_order.begin(), m_order.end(), [this](const auto& a, const auto& b) {
+            return priority(a) > priority(b);
+        });
+        m_dirty = false;
+    }
+
+private:
+    Index m_focus;
+    QSet<Index> m_pending;
+    QVector<Index> m_order;
+    bool m_dirty = false;
+};
+
+#endif // GENERATIONQUEUE_H
@@ -0,0 +1,51 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <QString>
+
+/**
+ * @brief The MemoryStats class accounts allocations and resident memory per conversion stage.
+ * Allocations are counted by replacing malloc, realloc and free, that is available only
+ * on Linux builds with MEMORY_STATS defined, otherwise only RSS is reported.
+ * Allocations are counted per thread and charged to the innermost stage open on that thread,
+ * a nested stage is not included in the stage around it.
+ */
+class MemoryStats {
+public:
+    struct Heap {
+        qint64 allocations = 0; // number of allocations
+        qint64 allocated = 0;   // bytes allocated
+        qint64 live = 0;        // bytes allocated and not yet freed
+    };
+    class Stage {
+    public:
+        explicit Stage(const char* name);
+        ~Stage();
+        Stage(const Stage&) = delete;
+        Stage& operator=(const Stage&) = delete;
+    private:
+        const char* m_name;
+        Stage* m_parent = nullptr;
+        Heap m_start;
+        Heap m_nested;              // taken by the stages opened within this one
+        qint64 m_startPeak = 0;
+        qint64 m_nestedPeak = 0;
+        bool m_active = false;
+    };
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static bool hasHeap();  // true if allocations are counted
+    static Heap heap();     // of the calling thread
+    static qint64 liveHeap(); // of all threads
+    static qint64 rss();    // current resident set in bytes
+    static qint64 peakRss();// high water mark of the resident set in bytes
+    static void add(const char* name, const Heap& heap, qint64 peakRaise);
+    static QString report();
+};
+
+#define MEMORY_STATS_CAT(a, b) a ## b
+#define MEMORY_STATS_CAT2(a, b) MEMORY_STATS_CAT(a, b)
+#define MEMORY_STAGE(name) MemoryStats::Stage MEMORY_STATS_CAT2(memory_stage_, __LINE__)(name)
+
+#endif // MEMORYSTATS_H
@@ -0,0 +1,65 @@
+#ifndef NETWORKREPLAY_H
+#define NETWORKREPLAY_H
+
+#include <QNetworkAccessManager>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QFile>
+#include <QDir>
+#include <QVector>
+#include <optional>
+
+class QNetworkReply;
+
+/**
+ * @brief The TrafficRecorder class writes each received response and its latency into a directory,
+ * traffic.jsonl has a line per response and bodies/ their contents.
+ */
+class TrafficRecorder {
+public:
+    struct Response {
+        QString url;
+        int status;
+        int error;
+        QString errorString;
+        QByteArray retryAfter;
+        qint64 ms;
+        QString body;   // file name relative to the directory
+    };
+    explicit TrafficRecorder(const QString& dirName);
+    static std::optional<QVector<Response>> read(const QDir& dir, QString& errorString);
+    static bool isRecording(const QString& dirName);
+    bool isValid() const;
+    QString errorString() const;
+    void record(QNetworkReply* reply, qint64 ms, const QByteArray& body);
+    void record(QNetworkReply* reply, qint64 ms, QFile& body);
+private:
+    QString write(QNetworkReply* reply, qint64 ms);
+private:
+    QDir m_dir;
+    QFile m_index;
+    QElapsedTimer m_elapsed;
+    int m_count = 0;
+};
+
+/**
+ * @brief The ReplayAccessManager class answers requests from a TrafficRecorder directory as
+ * they were recorded, status, headers, body and latency, without network.
+ */
+class ReplayAccessManager : public QNetworkAccessManager {
+    Q_OBJECT
+public:
+    using Response = TrafficRecorder::Response;
+    explicit ReplayAccessManager(const QString& dirName, QObject* parent = nullptr);
+    bool isValid() const;
+    QString errorString() const;
+protected:
+    QNetworkReply* createRequest(Operation op, const QNetworkRequest& request, QIODevice* outgoingData = nullptr) override;
+private:
+    QDir m_dir;
+    QString m_errorString;
+    QHash<QString, QVector<Response>> m_responses; // url -> responses in recorded order
+    QHash<QString, int> m_next;
+};
+
+#endif // NETWORKREPLAY_H
@@ -0,0 +1,69 @@
+#ifndef REQUESTSCHEDULER_H
+#define REQUESTSCHEDULER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <chrono>
+#include <functional>
+#include <optional>
+
+class QNetworkReply;
+
+/**
+ * @brief The RequestScheduler class runs network calls concurrently.
+ * API calls are rate limited with a token bucket, content (image) downloads only by the
+ * number of concurrent requests. On HTTP 429 (and 400 that Figma returns when overloaded) the call
+ * is retried after 'Retry-After' and the rate is halved, it recovers gradually on successful calls.
+ * A retried call keeps its kind.
+ */
+class RequestScheduler : public QObject {
+    Q_OBJECT
+public:
+    using NetworkFunction = std::function <QNetworkReply* ()>;
+    enum class Kind {Api, Content};
+    explicit RequestScheduler(QObject* parent = nullptr);
+    void setConcurrency(int concurrency);
+    void setInterval(int ms);   // a token per interval
+    void setBurst(int tokens);
+    void enqueue(const NetworkFunction& call, Kind kind = Kind::Api);
+    bool isEmpty() const;
+    int inFlight() const {return static_cast<int>(m_inFlight.size());}
+    void clear();
+    static std::optional<std::chrono::milliseconds> retryAfter(const QNetworkReply* reply);
+signals:
+    void dispatched(QNetworkReply* reply, const NetworkFunction& call);
+    void throttled();
+private slots:
+    void dispatch();
+private:
+    struct Call {
+        NetworkFunction call;
+        Kind kind;
+        qint64 notBefore = 0;   // m_clock ms, a retried call waits
+    };
+    void refill();
+    void schedule(std::chrono::milliseconds delay);
+    void start(const Call& call);
+    void finished(QNetworkReply* reply);
+    void retry(Call call, const std::optional<std::chrono::milliseconds>& retryAfter);
+    std::chrono::milliseconds backoff(const std::optional<std::chrono::milliseconds>& retryAfter);
+    std::chrono::milliseconds tokenInterval() const;
+private:
+    QQueue<Call> m_api;
+    QQueue<Call> m_content;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_refilled = 0;          // m_clock ms when tokens were last refilled
+    qint64 m_pausedUntil = 0;       // m_clock ms, no API calls before that
+    double m_tokens = 0;
+    double m_penalty = 1;           // token interval multiplier, grows on 429
+    int m_burst = 5;
+    int m_interval = 300;
+    int m_concurrency = 6;
+    QHash<QNetworkReply*, Call> m_inFlight;
+};
+
+#endif // REQUESTSCHEDULER_H
@@ -0,0 +1,43 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+
+/**
+ * @brief The SearchIndex class finds nodes from the generated document by their names, ids,
+ * texts, components and image references. Each hit tells where the node was generated to.
+ * Words of the indexed texts are kept sorted, a query matches hits having a word starting
+ * with each word of the query.
+ */
+class SearchIndex {
+public:
+    enum class Kind {Name, Id, Text, Component, Instance, Image};
+    struct Hit {
+        Kind kind;
+        QString text;       // what was found
+        QString nodeId;
+        int canvas;         // -1 if in a component
+        int element;        // -1 if in a component
+        QString file;       // generated file name, without a folder
+        int line;           // 1 based, 0 if not known
+    };
+public:
+    void clear();
+    void insert(const QString& file, const QVector<Hit>& hits);
+    QVector<Hit> find(const QString& query, int max) const;
+    int size() const;
+    static QString kindName(Kind kind);
+private:
+    static QStringList words(const QString& text);
+private:
+    QVector<Hit> m_hits;
+    QVector<bool> m_removed;                // hits of a file inserted again
+    QHash<QString, QVector<int>> m_files;   // file -> hits
+    QMap<QString, QVector<int>> m_words;    // lower case word -> hits
+    int m_count = 0;
+};
+
+#endif // SEARCHINDEX_H
@@ -0,0 +1,87 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+
+/**
+ * @brief The Tracer class collects timing spans of the conversion pipeline,
+ * they can be written out as a Chrome trace (chrome://tracing, Perfetto).
+ * Spans are recorded only when enabled, see FigmaQml::Timed.
+ */
+class Tracer {
+public:
+    class Span {
+    public:
+        Span(const char* category, const QString& name) : m_category(category) {
+            if(Tracer::isEnabled()) {
+                m_name = name;
+                m_start = Tracer::now();
+            }
+        }
+        ~Span() {
+            if(m_start >= 0)
+                Tracer::add(m_category, m_name, m_start);
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    private:
+        const char* m_category;
+        QString m_name;
+        qint64 m_start = -1;
+    };
+    class Sum;
+    /**
+     * Sums of the Sum scopes within, written as one span per name when it ends. Bounds the trace
+     * of work repeated many times, e.g. nodes of an element. Nested totals are kept apart.
+     */
+    class Totals {
+    public:
+        explicit Totals(const char* category);
+        ~Totals();
+        Totals(const Totals&) = delete;
+        Totals& operator=(const Totals&) = delete;
+    private:
+        friend class Sum;
+        struct Total {qint64 duration = 0; int count = 0;};
+        const char* m_category;
+        qint64 m_start = -1;
+        Totals* m_previous = nullptr;
+        QHash<QString, Total> m_totals;
+    };
+    // self time, i.e. without nested sums, is added to the innermost Totals of the thread
+    class Sum {
+    public:
+        explicit Sum(const QString& name);
+        ~Sum();
+        Sum(const Sum&) = delete;
+        Sum& operator=(const Sum&) = delete;
+    private:
+        Totals* m_totals = nullptr;
+        Sum* m_parent = nullptr;
+        QString m_name;
+        qint64 m_start = 0;
+        qint64 m_nested = 0;
+    };
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    // microseconds since the trace was started
+    static qint64 now();
+    // a span that started at 'start' and ends now, used for asynchronous work like network requests
+    static void add(const char* category, const QString& name, qint64 start);
+    // a span of given duration, count is written as its argument if not 0
+    static void add(const char* category, const QString& name, qint64 start, qint64 duration, int count);
+    static void clear();
+    static QByteArray toJson();
+    static bool write(const QString& fileName);
+};
+
+#define TRACE_CAT(a, b) a ## b
+#define TRACE_CAT2(a, b) TRACE_CAT(a, b)
+#define TRACE_SPAN(category, name) Tracer::Span TRACE_CAT2(trace_span_, __LINE__)(category, name)
+#define TRACE_TOTALS(category) Tracer::Totals TRACE_CAT2(trace_totals_, __LINE__)(category)
+#define TRACE_SUM(name) Tracer::Sum TRACE_CAT2(trace_sum_, __LINE__)(name)
+
+#endif // TRACER_H
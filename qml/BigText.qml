@@ -18,6 +18,10 @@ Item {
     readonly property alias lineCount: view.count
     property Component linePredessor
 
+    function showLine(line) {
+        view.positionViewAtIndex(line - 1, ListView.Beginning)
+    }
+
     Label {
         id: hidden
         visible: false
@@ -42,24 +42,20 @@ ListView {
     }
 
     function _format_included_view(index : int) {
+        const element = figmaQml.elements.get(index);
         const str =
-                (figmaQml.elements[index]["canvas"] + 1)
+                (element["canvas"] + 1)
                 + '-' +
-                (figmaQml.elements[index]["element"] + 1)
+                (element["element"] + 1)
                 + ' ' +
-               figmaQml.elements[index]["canvas_name"]
+               element["canvas_name"]
                 + '/' +
-                figmaQml.elements[index]["element_name"];
+                element["element_name"];
         return {content: str, index: index};
     }
 
     function _get_current_element() {
-        for(let i = 0; i < figmaQml.elements.length; ++i) {
-            if(figmaQml.currentCanvas === figmaQml.elements[i]["canvas"] &&
-                figmaQml.currentElement === figmaQml.elements[i]["element"])
-                    return i;
-        }
-        return -1;
+        return figmaQml.elements.row(figmaQml.currentCanvas, figmaQml.currentElement);
     }
 
     function add_view (index: int) {
@@ -88,7 +84,7 @@ ListView {
         }
         onAboutToShow: {
             included_list_add_items.clear()
-            for(let i = 0; i < figmaQml.elements.length; ++i) {
+            for(let i = 0; i < figmaQml.elements.count; ++i) {
                 const line = included_views._format_included_view(i);
                 for(let j = 0; j < included_list_items.count; ++j) {
                     let item = included_list_items.get(i);
@@ -251,12 +251,24 @@ ApplicationWindow {
                 text: "Fonts..."
                 onTriggered: fontMap.open();
             }
+            MenuItem {
+                enabled: figmaQml && figmaQml.isValid
+                text: "Find..."
+                onTriggered: find.open();
+                opacity: enabled ? 1 : 0.3
+            }
             MenuItem {
                 enabled: figmaQml && figmaQml.isValid
                 text: "Store..."
                 onTriggered: storeFile();
                 opacity: enabled ? 1 : 0.3
             }
+            MenuItem {
+                enabled: figmaQml && (figmaQml.flags & FigmaQml.Timed)
+                text: "Save trace..."
+                onTriggered: traceDialog.open();
+                opacity: enabled ? 1 : 0.3
+            }
             MenuItem {
                 enabled: figmaQml && figmaQml.isValid
                 text: "SendValue..."
@@ -284,13 +296,6 @@ ApplicationWindow {
                 onTriggered: Qt.exit(0);
             }
         }
-        // too much work
-        //TextField {
-        //    PlaceholderText: "Search"
-        //    onTextChanged: {
-        //        tabs.currentItem.
-        //    }
-        //}
     }
 
     header: Row {
@@ -427,6 +432,16 @@ ApplicationWindow {
                                     figmaQml.flags &= ~FigmaQml.NoGradients
                             }
                         }
+                        QtCheckBox {
+                            text: "Trace timing"
+                            checked: figmaQml.flags & FigmaQml.Timed
+                            onCheckedChanged: {
+                                if(checked)
+                                    figmaQml.flags |= FigmaQml.Timed
+                                else
+                                    figmaQml.flags &= ~FigmaQml.Timed
+                            }
+                        }
                         QtCheckBox {
                             text: "Loader placeholders"
                             visible: has_qul
@@ -874,6 +889,21 @@ ApplicationWindow {
     }
 
 
+    FileDialog {
+        id: traceDialog
+        title: "Save trace"
+        currentFile: "file:///" + encodeURIComponent(documentName + "_trace.json")
+        currentFolder: figmaQml.documentsLocation
+        nameFilters: [ "Chrome trace files (*.json)", "All files (*)" ]
+        fileMode: FileDialog.SaveFile
+        onAccepted: {
+            let path = traceDialog.currentFile.toString();
+            path = path.replace(/^(file:\/\/)/,"");
+            if(figmaQml.saveTrace(path))
+                info.text = path + " saved";
+        }
+    }
+
     function restoreFile() {
         if(isWebAssembly) {
             figmaQML.restore();
@@ -959,6 +989,50 @@ ApplicationWindow {
         }
     }
 
+    Popup {
+        id: find
+        anchors.centerIn: main.contentItem
+        modal: true
+        focus: true
+        width: 600
+        height: 400
+        closePolicy: Popup.CloseOnEscape | Popup.CloseOnReleaseOutside
+        onOpened: find_text.forceActiveFocus()
+        function show(hit) {
+            if(hit.canvas >= 0) {
+                canvasSpinner.value = hit.canvas + 1
+                elementSpinner.value = hit.element + 1
+            }
+            tabs.currentIndex = 0
+            sourceChooser.text = hit.file.replace(/\.qml$/, "")
+            if(hit.line > 0)
+                Qt.callLater(() => qmlText.showLine(hit.line))
+            find.close()
+        }
+        contentItem: ColumnLayout {
+            TextField {
+                id: find_text
+                Layout.fillWidth: true
+                placeholderText: "Name, id, text, component or image"
+                onTextEdited: find_results.model = figmaQml.find(text)
+                onAccepted: if(find_results.count > 0) find.show(find_results.model[0])
+            }
+            ListView {
+                id: find_results
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                clip: true
+                delegate: ItemDelegate {
+                    width: find_results.width
+                    text: (modelData.canvas >= 0 ? (modelData.canvas + 1) + "-" + (modelData.element + 1) : "component")
+                          + " " + modelData.file + ":" + modelData.line + " " + modelData.kind + " \"" + modelData.text + "\""
+                    onClicked: find.show(modelData)
+                }
+                ScrollBar.vertical: ScrollBar {}
+            }
+        }
+    }
+
     ImportEditor {
         id: imports
         anchors.centerIn: main.contentItem
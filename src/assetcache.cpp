@@ -0,0 +1,115 @@
+#include "assetcache.h"
+#include "figmastore.h"
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QLockFile>
+#include <QDateTime>
+#include <QSet>
+
+constexpr auto BlobFolder = "blobs";
+constexpr auto KeyFolder = "keys";
+constexpr auto TrimLock = "trim.lock";
+constexpr auto TrimRatio = 0.9;   // trimmed below the limit not to trim on every insert
+constexpr auto TrimInterval = 10; // of the limit written before trimmed again
+
+// trim removes the least recently used blobs first
+static void touch(QFile& blob) {
+    blob.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+}
+
+AssetCache::AssetCache(const QString& dirName) : m_dir(dirName) {
+}
+
+QString AssetCache::defaultDir() {
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/assets";
+}
+
+// 0 disables the cache
+void AssetCache::setLimit(qint64 bytes) {
+    m_limit = bytes;
+    if(m_limit > 0 && m_dir.mkpath(BlobFolder) && m_dir.mkpath(KeyFolder))
+        trim();
+}
+
+bool AssetCache::isEnabled() const {
+    return m_limit > 0;
+}
+
+QString AssetCache::keyFile(const QString& key) const {
+    return m_dir.filePath(QString("%1/%2").arg(KeyFolder, QString::fromLatin1(FigmaStore::checksum(key.toUtf8()).toHex())));
+}
+
+std::optional<std::tuple<QByteArray, int>> AssetCache::find(const QString& key) {
+    if(!isEnabled())
+        return std::nullopt;
+    QFile keyEntry(keyFile(key));
+    if(!keyEntry.open(QIODevice::ReadOnly))
+        return std::nullopt;
+    const auto fields = keyEntry.readAll().trimmed().split(' ');
+    keyEntry.close();
+    if(fields.size() != 2)
+        return std::nullopt;
+    QFile blob(m_dir.filePath(QString("%1/%2").arg(BlobFolder, QString::fromLatin1(fields[0]))));
+    if(!blob.open(QIODevice::ReadOnly)) {
+        keyEntry.remove(); // trimmed away
+        return std::nullopt;
+    }
+    const auto bytes = blob.readAll();
+    if(FigmaStore::checksum(bytes).toHex() != fields[0])
+        return std::nullopt;
+    touch(blob);
+    return std::make_tuple(bytes, fields[1].toInt());
+}
+
+void AssetCache::insert(const QString& key, const QByteArray& bytes, int format) {
+    if(!isEnabled() || bytes.size() > m_limit)
+        return;
+    const auto hash = FigmaStore::checksum(bytes).toHex();
+    const auto blobName = m_dir.filePath(QString("%1/%2").arg(BlobFolder, QString::fromLatin1(hash)));
+    if(QFile existing(blobName); existing.open(QIODevice::ReadOnly)) {
+        touch(existing); // shared with another key, now used again
+    } else {
+        QSaveFile blob(blobName);
+        if(!blob.open(QIODevice::WriteOnly) || blob.write(bytes) != bytes.size() || !blob.commit())
+            return;
+        m_written += bytes.size();
+    }
+    QSaveFile keyEntry(keyFile(key));
+    if(!keyEntry.open(QIODevice::WriteOnly))
+        return;
+    keyEntry.write(hash + ' ' + QByteArray::number(format) + '\n');
+    keyEntry.commit();
+    if(m_written > m_limit / TrimInterval)
+        trim();
+}
+
+// oldest blobs first, keys referring removed blobs are removed too
+void AssetCache::trim() {
+    m_written = 0;
+    QLockFile lock(m_dir.filePath(TrimLock));
+    if(!lock.tryLock(0))
+        return; // another process is trimming
+    const auto blobs = QDir(m_dir.filePath(BlobFolder)).entryInfoList(QDir::Files, QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for(const auto& blob : blobs)
+        total += blob.size();
+    if(total <= m_limit)
+        return;
+    QSet<QByteArray> removed;
+    for(const auto& blob : blobs) {
+        if(total <= m_limit * TrimRatio)
+            break;
+        if(QFile::remove(blob.filePath())) {
+            total -= blob.size();
+            removed.insert(blob.fileName().toLatin1());
+        }
+    }
+    const auto keys = QDir(m_dir.filePath(KeyFolder)).entryInfoList(QDir::Files);
+    for(const auto& key : keys) {
+        QFile keyEntry(key.filePath());
+        if(keyEntry.open(QIODevice::ReadOnly) && removed.contains(keyEntry.readAll().split(' ').value(0))) {
+            keyEntry.close();
+            keyEntry.remove();
+        }
+    }
+}
@@ -1,13 +1,18 @@
 #include "downloads.h"
 #include <QNetworkReply>
 #include <QQmlEngine>
+#include <QMetaEnum>
 #include <QTimer>
 
-
+// progress callbacks only update counters, properties are notified at most this often
+constexpr int PublishInterval = 100; //ms
 
 
 Downloads::Downloads(QObject* parent) : QObject(parent) {
     qmlRegisterUncreatableType<Downloads>("FigmaGet", 1, 0, "Downloads", "");
+    m_publish.setSingleShot(true);
+    m_publish.setInterval(PublishInterval);
+    QObject::connect(&m_publish, &QTimer::timeout, this, &Downloads::publish);
     QObject::connect(this, &Downloads::cancelled, this, [this]() {
         if(m_progresses.empty())
             return;
@@ -16,6 +21,7 @@ Downloads::Downloads(QObject* parent) : QObject(parent) {
         for(auto& [r, v] : clone) {
            r->abort();
         }
+        setDownloading(false);
     }, Qt::QueuedConnection);
 }
 
@@ -29,88 +35,124 @@ void Downloads::cancel() {
 
 void Downloads::reset() {
     m_progresses.clear();
-    m_past = 0;
-    m_bytesReceived = 0;
-    m_bytesTotal = 0;
-    emit bytesTotalChanged();
-    emit bytesReceivedChanged();
-    emit downloadsChanged();
+    m_totals = {};
+    m_categories = {};
+    m_publish.stop();
+    publish();
+    setDownloading(false);
+}
+
+void Downloads::add(Category category, qint64 bytesReceived, qint64 bytesTotal, int downloads) {
+    m_totals.bytesReceived += bytesReceived;
+    m_totals.bytesTotal += bytesTotal;
+    m_totals.downloads += downloads;
+    auto& c = m_categories[category];
+    c.bytesReceived += bytesReceived;
+    c.bytesTotal += bytesTotal;
+    c.downloads += downloads;
+    if(!m_publish.isActive())
+        m_publish.start();
+}
+
+void Downloads::setDownloading(bool downloading) {
+    if(m_downloading == downloading)
+        return;
+    m_downloading = downloading;
     emit downloadingChanged();
 }
 
-void Downloads::setProgress(QNetworkReply* reply, qint64 bytesReceived, qint64 bytesTotal) {
-    if(m_progresses.find(reply) != m_progresses.end()) {
-        auto& r = m_progresses[reply];
-        if(std::get<0>(r) != bytesReceived) {
-            std::get<0>(r) = bytesReceived;
-            emit bytesReceivedChanged();
-        }
-        if(std::get<1>(r) != bytesTotal) {
-            std::get<1>(r) = bytesTotal;
-            emit bytesTotalChanged();
-        }
-    } else {
-        if(reply) {
-            QObject::connect(reply, &QNetworkReply::destroyed, this, &Downloads::onDestroy);
-            m_progresses.emplace(reply, std::tuple<qint64, qint64, NetworkFunction>{bytesReceived, bytesTotal, nullptr});
-            emit downloadsChanged();
-        } else {
-            m_bytesReceived += bytesReceived;
-            m_bytesTotal += bytesTotal;
-        }
-        emit bytesTotalChanged();
+void Downloads::publish() {
+    if(m_published.bytesReceived != m_totals.bytesReceived)
         emit bytesReceivedChanged();
+    if(m_published.bytesTotal != m_totals.bytesTotal)
+        emit bytesTotalChanged();
+    if(m_published.downloads != m_totals.downloads)
+        emit downloadsChanged();
+    if(m_publishedCategories != m_categories)
+        emit categoriesChanged();
+    m_published = m_totals;
+    m_publishedCategories = m_categories;
+}
+
+void Downloads::setProgress(QNetworkReply* reply, qint64 bytesReceived, qint64 bytesTotal, Category category) {
+    if(!reply) {
+        add(category, bytesReceived, bytesTotal, 0);
+        return;
+    }
+    auto it = m_progresses.find(reply);
+    if(it == m_progresses.end()) {
+        QObject::connect(reply, &QNetworkReply::destroyed, this, &Downloads::onDestroy);
+        it = m_progresses.emplace(reply, Progress{0, 0, category, nullptr}).first;
+        add(category, 0, 0, 1);
         emit downloadStart();
-        emit downloadingChanged();
+        setDownloading(true);
     }
+    auto& p = it->second;
+    if(p.category != category) {
+        // monitor() does not know the category, move what is counted so far
+        add(p.category, -p.bytesReceived, -p.bytesTotal, -1);
+        add(category, p.bytesReceived, p.bytesTotal, 1);
+        p.category = category;
+    }
+    add(category, bytesReceived - p.bytesReceived, bytesTotal - p.bytesTotal, 0);
+    p.bytesReceived = bytesReceived;
+    p.bytesTotal = bytesTotal;
 }
 
+// totals already contain the bytes of a finished reply
 void Downloads::onDestroy(QObject* thisItem) {
-    const auto r = static_cast<QNetworkReply*>(thisItem);
-    m_bytesReceived += std::get<0>(m_progresses[r]);
-    m_bytesTotal += std::get<1>(m_progresses[r]);
-    m_progresses.erase(r);
-    ++m_past;
-    emit downloadEnd();
-    emit downloadingChanged();
-    emit downloadsChanged();
+    if(m_progresses.erase(static_cast<QNetworkReply*>(thisItem)) > 0)
+        emit downloadEnd();
+    setDownloading(!m_progresses.empty());
 }
 
 void Downloads::monitor(QNetworkReply* reply, const NetworkFunction &f) {
     if(!reply)
         return;
-    if(m_progresses.find(reply) == m_progresses.end()) {
+    const auto it = m_progresses.find(reply);
+    if(it == m_progresses.end()) {
         QObject::connect(reply, &QNetworkReply::destroyed, this, &Downloads::onDestroy);
-        m_progresses.emplace(reply, std::tuple<qint64, qint64, NetworkFunction>{0, 0, f});
-        emit downloadsChanged();
+        m_progresses.emplace(reply, Progress{0, 0, Other, f});
+        add(Other, 0, 0, 1);
+        emit downloadStart();
+        setDownloading(true);
     } else
-        std::get<NetworkFunction>(m_progresses[reply]) = f;
+        it->second.call = f;
 }
 
 NetworkFunction Downloads::monitored(QNetworkReply* reply) {
-    return std::get<NetworkFunction>(m_progresses[reply]);
+    const auto it = m_progresses.find(reply);
+    return it != m_progresses.end() ? it->second.call : nullptr;
 }
 
 qint64 Downloads::bytesReceived() const {
-    qint64 sum = 0;
-    for(const auto& [r, v] : m_progresses) {
-        sum += std::get<0>(v);
-    }
-    return sum + m_bytesReceived;
+    return m_published.bytesReceived;
 }
 
 qint64 Downloads::bytesTotal() const {
-    qint64 sum = 0;
-    for(const auto& [r, v] : m_progresses) {
-        sum += std::get<1>(v);
-    }
-    return sum + m_bytesTotal;
+    return m_published.bytesTotal;
 }
 
 int Downloads::downloads() const {
-    return m_progresses.size() + m_past;
+    return m_published.downloads;
 }
 
 int Downloads::activeDownloads() const {
     return m_progresses.size();
 }
+
+// category name -> {bytesReceived, bytesTotal, downloads}
+QVariantMap Downloads::categories() const {
+    const auto meta = QMetaEnum::fromType<Category>();
+    QVariantMap map;
+    for(auto c = 0; c < CategoryCount; ++c) {
+        const auto& t = m_publishedCategories[c];
+        if(t.downloads == 0 && t.bytesTotal == 0)
+            continue;
+        map.insert(QString(meta.valueToKey(c)).toLower(), QVariantMap{
+                       {"bytesReceived", t.bytesReceived},
+                       {"bytesTotal", t.bytesTotal},
+                       {"downloads", t.downloads}});
+    }
+    return map;
+}
@@ -0,0 +1,102 @@
+#include "elementmodel.h"
+#include "figmadocument.h"
+#include <QQmlEngine>
+
+ElementModel::ElementModel(QObject* parent) : QAbstractListModel(parent) {
+    qmlRegisterUncreatableType<ElementModel>("FigmaQml", 1, 0, "ElementModel", "");
+}
+
+int ElementModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(m_indices.size());
+}
+
+int ElementModel::count() const {
+    return rowCount();
+}
+
+QHash<int, QByteArray> ElementModel::roleNames() const {
+    return {
+        {CanvasRole, "canvas"},
+        {ElementRole, "element"},
+        {CanvasNameRole, "canvas_name"},
+        {ElementNameRole, "element_name"},
+        {ReadyRole, "ready"}
+    };
+}
+
+QVariant ElementModel::data(const QModelIndex& index, int role) const {
+    if(!m_doc || !index.isValid() || index.row() >= rowCount())
+        return QVariant();
+    const auto& [canvas_index, element_index] = m_indices[index.row()];
+    switch(role) {
+    case CanvasRole: return canvas_index;
+    case ElementRole: return element_index;
+    case CanvasNameRole: return (*(m_doc->begin() + canvas_index))->name();
+    case Qt::DisplayRole:
+    case ElementNameRole: return (*(m_doc->begin() + canvas_index))->name(element_index);
+    case ReadyRole: return static_cast<bool>(m_ready[index.row()]);
+    default: return QVariant();
+    }
+}
+
+QVariantMap ElementModel::get(int row) const {
+    QVariantMap map;
+    if(row < 0 || row >= rowCount())
+        return map;
+    const auto names = roleNames();
+    for(const auto& [role, name] : names.asKeyValueRange())
+        map.insert(name, data(index(row), role));
+    return map;
+}
+
+int ElementModel::row(int canvas, int element) const {
+    if(canvas < 0 || canvas >= static_cast<int>(m_offsets.size()))
+        return -1;
+    const auto row = m_offsets[canvas] + element;
+    const auto end = canvas + 1 < static_cast<int>(m_offsets.size()) ? m_offsets[canvas + 1] : rowCount();
+    return element >= 0 && row < end ? row : -1;
+}
+
+void ElementModel::setDocument(const FigmaDocument* doc, const QSet<Index>& pending) {
+    if(!m_indices.empty()) {
+        beginRemoveRows(QModelIndex(), 0, rowCount() - 1);
+        m_doc = nullptr;
+        m_indices.clear();
+        m_offsets.clear();
+        m_ready.clear();
+        endRemoveRows();
+    }
+    m_doc = nullptr;
+    if(doc) {
+        std::vector<Index> indices;
+        std::vector<int> offsets;
+        std::vector<bool> ready;
+        int canvas_index = 0;
+        for(const auto& canvas : *doc) {
+            offsets.push_back(static_cast<int>(indices.size()));
+            for(int element_index = 0; element_index < canvas->size(); ++element_index) {
+                indices.push_back({canvas_index, element_index});
+                ready.push_back(!pending.contains({canvas_index, element_index}));
+            }
+            ++canvas_index;
+        }
+        if(!indices.empty())
+            beginInsertRows(QModelIndex(), 0, static_cast<int>(indices.size()) - 1);
+        m_doc = doc;
+        m_indices.swap(indices);
+        m_offsets.swap(offsets);
+        m_ready.swap(ready);
+        if(!m_indices.empty())
+            endInsertRows();
+    }
+    emit countChanged();
+}
+
+void ElementModel::setReady(const Index& index) {
+    const auto r = row(index.first, index.second);
+    if(r < 0 || m_ready[r])
+        return;
+    m_ready[r] = true;
+    const auto model_index = this->index(r);
+    emit dataChanged(model_index, model_index, {ReadyRole});
+}
@@ -267,7 +267,7 @@ std::optional<std::tuple<QStringList, QStringList, QStringList>> ExecuteUtils::w
 
     const auto els = figmaQml.elements();
     for(const auto& var : elements) {
-        const auto& map = els[var].toMap();
+        const auto map = els->get(var);
         const auto element_name = map["element_name"].toString();
         const auto canvas_index = map["canvas"].toInt();
         const auto element_index = map["element"].toInt();
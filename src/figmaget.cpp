@@ -1,18 +1,29 @@
 #include "figmaget.h"
 #include "figmadata.h"
+#include "figmastore.h"
 #include "functorslot.h"
 #include "downloads.h"
+#include "requestscheduler.h"
+#include "networkreplay.h"
+#include "assetcache.h"
 #include "utils.h"
+#include "tracer.h"
+#include "memorystats.h"
 #include <QQmlEngine>
 #include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QJsonArray>
 #include <QImageReader>
 #include <QImageWriter>
 #include <QBuffer>
 #include <QFile>
 #include <QFileInfo>
+#include <QTemporaryFile>
 #include <QAbstractEventDispatcher>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QPointer>
 #include <memory>
 
 
@@ -25,13 +36,90 @@ constexpr auto TIMEOUT_ERR = "%1 timeout \"%2\"";
 
 constexpr auto TimeoutTime = 60 * 1000;
 
-constexpr auto ImageRetry = 60 * 1000;
+constexpr auto MaxUrlLength = 2000; // safe for servers and proxies
+
+constexpr auto MaxRenderingChunk = 20; // rendering is slow on server, smaller chunks are rendered concurrently
+
+constexpr auto MaxRenderingRetries = 2;
+
+constexpr auto StreamBufferSize = 64 * 1024;
 
 enum Format {
     None = 0, JPEG, PNG
 };
 
-const QLatin1String StreamId("FQ03");
+// collects the subtrees of a scoped fetch, the document is assembled when all chunks are received
+struct FigmaGet::ScopedFetch {
+    QJsonObject skeleton; // shallow document, pages and their elements only
+    QString version;
+    int pending;
+    QHash<QString, QJsonObject> subtrees;
+    QJsonObject components;
+    QJsonObject componentSets;
+    QJsonObject styles;
+    QByteArray document() const;
+};
+
+// the fetched subtrees replace their shallow counterparts, elements out of scope are kept as
+// empty frames so that page and element indices are same as in the full document
+QByteArray FigmaGet::ScopedFetch::document() const {
+    const auto stub = [](const QJsonObject& element) {
+        auto shallow = element;
+        shallow.remove("children");
+        const auto type = shallow["type"].toString();
+        if(type == "COMPONENT" || type == "COMPONENT_SET")
+            shallow["type"] = "FRAME"; // not to be mistaken as a component, the real one is fetched as a node if used
+        return shallow;
+    };
+    auto doc = skeleton["document"].toObject();
+    auto pages = doc["children"].toArray();
+    for(auto p = 0; p < pages.size(); ++p) {
+        auto page = pages[p].toObject();
+        const auto pageId = page["id"].toString();
+        if(subtrees.contains(pageId)) {
+            pages[p] = subtrees[pageId];
+            continue;
+        }
+        auto children = page["children"].toArray();
+        for(auto e = 0; e < children.size(); ++e) {
+            const auto element = children[e].toObject();
+            const auto id = element["id"].toString();
+            children[e] = subtrees.contains(id) ? subtrees[id] : stub(element);
+        }
+        page["children"] = children;
+        pages[p] = page;
+    }
+    doc["children"] = pages;
+    auto reduced = skeleton;
+    reduced["document"] = doc;
+    reduced["components"] = components;
+    reduced["componentSets"] = componentSets;
+    reduced["styles"] = styles;
+    return QJsonDocument(reduced).toJson(QJsonDocument::Compact);
+}
+
+// decodes directly into the scaled size, hence the full size image is never in memory,
+// returns an error string if failed
+static QString resizeImage(QByteArray& bytes, const QByteArray& format, const QSize& size) {
+    QImage scaled;
+    {
+        QBuffer imageBuffer(&bytes);
+        QImageReader imageReader(&imageBuffer, format);
+        imageReader.setScaledSize(size); // JPEGs are scaled while decoding, others smoothly after
+        scaled = imageReader.read();
+    }
+    QByteArray resized;
+    QBuffer buffer(&resized);
+    if(scaled.isNull() || !buffer.open(QIODevice::WriteOnly))
+        return QString(" cannot be resized to %1x%2").arg(size.width()).arg(size.height());
+
+    QImageWriter writer(&buffer, format);
+    if(!writer.write(scaled))
+        return QString(" cannot be resized %1").arg(writer.errorString());
+    buffer.close();
+    bytes.swap(resized);
+    return QString();
+}
 
 // otherwise id can conflict
 QString asTimeoutId(const QString& id) {
@@ -52,8 +140,12 @@ FigmaGet::FigmaGet(QObject *parent) : FigmaProvider(parent),
     m_timeout{new Timeout(this)},
     m_error{new Execute(this)},
     m_downloads(new Downloads(this)),
-    m_images(new FigmaData),
-    m_renderings(new FigmaData),
+    m_scheduler(new RequestScheduler(this)),
+    m_imagePool(new QThreadPool(this)),
+    m_assetCache(new AssetCache),
+    m_blobs(std::make_shared<FigmaBlobs>()),
+    m_images(new FigmaData(m_blobs)),
+    m_renderings(new FigmaData(m_blobs)),
     m_nodes(new FigmaData) {
 
      qmlRegisterUncreatableType<FigmaGet>("FigmaGet", 1, 0, "FigmaGet", "");
@@ -61,10 +153,25 @@ FigmaGet::FigmaGet(QObject *parent) : FigmaProvider(parent),
     QObject::connect(this, &FigmaGet::projectTokenChanged, this, &FigmaGet::reset);
 
     QObject::connect(m_downloads, &Downloads::cancelled, this, [this]() {
-         m_checksum = 0;
+         m_version.clear();
      });
 
-     QObject::connect(&m_callTimer, &QTimer::timeout, this, &FigmaGet::doCall, Qt::QueuedConnection);
+     QObject::connect(m_scheduler, &RequestScheduler::dispatched, m_downloads, &Downloads::monitor);
+     QObject::connect(m_scheduler, &RequestScheduler::throttled, m_downloads, &Downloads::tooManyRequests);
+     QObject::connect(this, &FigmaGet::throttleChanged, this, [this]() {
+         m_scheduler->setInterval(m_throttle);
+     });
+     QObject::connect(this, &FigmaGet::concurrencyChanged, this, [this]() {
+         m_scheduler->setConcurrency(m_concurrency);
+     });
+     QObject::connect(this, &FigmaGet::memoryBudgetChanged, this, [this]() {
+         m_blobs->setBudget(qint64(m_memoryBudget) * 1024 * 1024);
+     });
+     m_scheduler->setInterval(m_throttle);
+     m_scheduler->setConcurrency(m_concurrency);
+     m_blobs->setBudget(qint64(m_memoryBudget) * 1024 * 1024);
+     QObject::connect(this, &FigmaGet::assetCacheSizeChanged, this, &FigmaGet::updateAssetCache);
+     updateAssetCache();
 
      QObject::connect(this, &FigmaGet::error, [this](const QString&) {
          cancel();
@@ -98,8 +205,9 @@ FigmaGet::FigmaGet(QObject *parent) : FigmaProvider(parent),
 void FigmaGet::onRetrievedImage(const QString& imageRef) {
     Q_ASSERT(FetchFailedDebug.find(imageRef) == FetchFailedDebug.end());
     if(m_images->contains(imageRef)) {
-        if(!m_images->isEmpty(imageRef)) {
-            emit imageReady(imageRef, m_images->data(imageRef), m_images->format(imageRef));
+        if(const auto image = m_images->committed(imageRef)) {
+            const auto& [bytes, format] = *image;
+            emit imageReady(imageRef, bytes, format);
         } else {
 #ifdef  QT_DEBUG
             FetchFailedDebug.insert(imageRef);
@@ -109,8 +217,9 @@ void FigmaGet::onRetrievedImage(const QString& imageRef) {
         }
     }
     else if(m_renderings->contains(imageRef)) {
-        if(!m_renderings->isEmpty(imageRef)) {
-            emit renderingReady(imageRef, m_renderings->data(imageRef), m_renderings->format(imageRef));
+        if(const auto rendering = m_renderings->committed(imageRef)) {
+            const auto& [bytes, format] = *rendering;
+            emit renderingReady(imageRef, bytes, format);
         } else {
             m_renderings->setError(imageRef);
             emit error(QString("Rendering cannot be retrieved \"%1\"").arg(imageRef));
@@ -120,8 +229,8 @@ void FigmaGet::onRetrievedImage(const QString& imageRef) {
 
 void FigmaGet::onRetrievedNode(const QString& nodeId) {
 
-     if(!m_nodes->isEmpty(nodeId)) {
-         emit nodeReady(m_nodes->data(nodeId));
+     if(const auto node = m_nodes->committed(nodeId)) {
+         emit nodeReady(std::get<QByteArray>(*node));
      } else {
          m_nodes->setError(nodeId);
          emit error(QString("Node cannot be retrieved \"%1\"").arg(nodeId));
@@ -130,18 +239,20 @@ void FigmaGet::onRetrievedNode(const QString& nodeId) {
 
 bool FigmaGet::isReady() {
 
-    return m_callQueue.isEmpty() && m_timeout->pending() == 0;
+    return m_scheduler->isEmpty() && m_replies.isEmpty() && m_resizing == 0;
 }
 
 void FigmaGet::doFinished(QNetworkReply* rep)
 {
     if(rep->error() == QNetworkReply::NoError) { // error handled after this
-        auto& reply_data = m_replies[rep];
-        auto data = std::get<std::shared_ptr<QByteArray>>(reply_data);
-        *data += rep->readAll();
+        if(!readReply(rep))
+            return;
         Q_ASSERT(rep->isFinished());
-        std::get<FinishedFunction>(reply_data)();
-        m_replies.remove(rep);
+        const auto request = m_replies.take(rep);
+        recordReply(rep, request);
+        request.finished();
+    } else if(m_replies.contains(rep) && rep->error() != QNetworkReply::OperationCanceledError) {
+        recordReply(rep, m_replies[rep]); // cancels are ours, not server's
     }
 }
 
@@ -150,7 +261,7 @@ void FigmaGet::retrieveImage(const Id& id,  FigmaData* target, const QSize& maxS
     Q_ASSERT(maxSize.width() > 0 && maxSize.height() > 0);
     queueCall([this, id, target, maxSize]() {
         return doRetrieveImage(id, target, maxSize);
-    });
+    }, false); // image content is not from the API, but a file server
 }
 
  void FigmaGet::requestRendering(const Id& imageId) {
@@ -158,40 +269,65 @@ void FigmaGet::retrieveImage(const Id& id,  FigmaData* target, const QSize& maxS
      if(!imageId.isEmpty()) {
         m_rendringQueue.append(imageId.id);
      }
-     queueCall([this, imageId](){
-         return FigmaGet::doRequestRendering(imageId);
+     queueCall([this](){
+         return FigmaGet::doRequestRendering();
      });
  }
 
 
 
-void FigmaGet::retrieveNode(const Id& id) {
-     queueCall([this, id]() {
-         doRetrieveNode(id);
-         return nullptr;
+// the batch is taken when the call is first run, a retried call requests the same ids
+void FigmaGet::retrieveNodes() {
+     const auto batch = std::make_shared<QStringList>();
+     queueCall([this, batch]() {
+         return doRetrieveNodes(*batch);
      });
  }
 
 bool FigmaGet::store(const QString& filename, unsigned flags, const QVariantMap& imports) {
 #ifdef Q_OS_WINDOWS
-    QFile file(filename.startsWith('/') ? filename.mid(1) : filename);
+    const auto name = filename.startsWith('/') ? filename.mid(1) : filename;
 #else
-    QFile file(filename);
+    const auto name = filename;
 #endif
-    if(file.open(QIODevice::WriteOnly)) {
-        QDataStream stream(&file);
-        if(!write(stream, flags, imports)) {
-            emit error("Store failed " + filename);
+    // a store of the same project is updated in place, only changed entries are appended
+    FigmaStore existing;
+    const auto append = existing.open(name) && existing.meta().projectToken == m_projectToken;
+    existing.close();
+    const auto reopen = m_store && QFileInfo(m_store->fileName()) == QFileInfo(name);
+    FigmaStore::Writer writer(name, append ? FigmaStore::Writer::Mode::Append : FigmaStore::Writer::Mode::Replace);
+    if(!write(writer)) {
+        emit error("Store error: " + writer.errorString());
+        return false;
+    } // a failed append is rolled back when the writer is gone
+    QString writeError;
+    const auto commit = [&]() {
+        if(writer.commit({m_projectToken,
+                           m_dataScope.isEmpty() ? m_version : QString(), // a reduced document is fetched again on update
+                           flags, imports}))
+            return true;
+        writeError = writer.errorString();
+        return false;
+    };
+    // entries not loaded yet are read from the file written, loads wait while it is written
+    if(reopen) {
+        if(!m_store->update(commit) && writeError.isEmpty()) {
+            emit error("Restore error: " + m_store->errorString());
             return false;
         }
     } else {
-      emit error("Store error: " + file.errorString() + " "  + filename);
-      return false;
+        commit();
+    }
+    if(!writeError.isEmpty()) {
+        emit error("Store failed " + writeError);
+        return false;
     }
     return true;
 }
 
 FigmaGet::~FigmaGet() {
+    m_imagePool->clear();
+    m_imagePool->waitForDone(); // resized images are posted to this
 }
 
 bool FigmaGet::restore(const QString& filename) {
@@ -200,7 +336,17 @@ bool FigmaGet::restore(const QString& filename) {
 #else
     QFile file(filename);
 #endif
-    if(file.open(QIODevice::ReadOnly)) {
+    if(FigmaStore::isStore(file.fileName())) {
+        auto store = std::make_shared<FigmaStore>();
+        if(!store->open(file.fileName())) {
+            emit error("Restore error: " + store->errorString());
+            return false;
+        }
+        if(!read(store)) {
+            emit error("Restore file corrupted, " + store->errorString());
+            return false;
+        }
+    } else if(file.open(QIODevice::ReadOnly)) {
         QDataStream stream(&file);
         if(!read(stream)) {
             emit error("Restore failed on " + filename);
@@ -217,60 +363,71 @@ bool FigmaGet::restore(const QString& filename) {
     return true;
 }
 
-bool FigmaGet::write(QDataStream& stream, unsigned flags, const QVariantMap& imports) const {
+bool FigmaGet::write(FigmaStore::Writer& writer) const {
+    return writer.add(FigmaStore::Document, {}, {}, 0, m_data)
+            && m_images->write(writer, FigmaStore::Images)
+            && m_renderings->write(writer, FigmaStore::Renderings)
+            && m_nodes->write(writer, FigmaStore::Nodes);
+}
 
-    stream << QString(StreamId);
-    stream << m_projectToken;
-    stream << m_data;
-    stream << m_checksum;
-    stream << flags;
-    stream << imports;
+// only the document is read now, assets when asked
+bool FigmaGet::read(const std::shared_ptr<FigmaStore>& store) {
+    reset();
+    const auto data = store->load(FigmaStore::Document, {});
+    if(!data)
+        return false;
+    const auto& meta = store->meta();
+    m_projectToken = meta.projectToken;
+    emit projectTokenChanged();
+    m_data = *data;
+    m_documentFile.reset();
+    m_version = meta.version;
+    m_dataScope.clear();
 
+    m_images->read(store, FigmaStore::Images);
+    m_renderings->read(store, FigmaStore::Renderings);
+    m_nodes->read(store, FigmaStore::Nodes);
+    m_store = store;
 
-    m_images->write(stream);
-    m_renderings->write(stream);
-    m_nodes->write(stream);
-    return stream.status() == QDataStream::Ok;
+    emit restored(meta.flags, meta.imports);
+    return true;
 }
 
 bool FigmaGet::read(QDataStream& stream) {
 
     reset();
-    QString streamid;
-    stream >> streamid;
-
-    if(streamid  != StreamId)
+    const auto meta = FigmaStore::readLegacy(stream, m_data);
+    if(!meta)
         return false;
-
-    stream >> m_projectToken;
+    m_projectToken = meta->projectToken;
     emit projectTokenChanged();
-
-    stream >> m_data;
-    stream >> m_checksum;
-    unsigned flags;
-    stream >> flags;
-
-    QVariantMap imports;
-    stream >> imports;
+    m_documentFile.reset();
+    m_version = meta->version;
+    m_dataScope.clear();
 
     m_images->read(stream);
     m_renderings->read(stream);
     m_nodes->read(stream);
 
-    emit restored(flags, imports);
+    emit restored(meta->flags, meta->imports);
     return stream.status() == QDataStream::Ok;
 }
 
 void FigmaGet::reset() {
     m_timeout->reset();
-    m_callTimer.stop();
+    m_scheduler->clear();
     m_downloads->reset();
     m_images->clear();
     m_renderings->clear();
     m_nodes->clear();
-    m_callQueue.clear();
+    m_store.reset();
     m_rendringQueue.clear();
+    m_nodeQueue.clear();
+    m_renderingRetries.clear();
+    m_renderingStats.clear();
+    emit renderingStatsChanged();
     m_replies.clear();
+    m_receivedFile.reset();
     m_lastError = nullptr;
 }
 
@@ -284,74 +441,68 @@ void FigmaGet::cancel() {
     m_downloads->cancel();
 }
 
-void FigmaGet::doCall() {
-    if(m_callQueue.isEmpty()) {
-
-        m_callTimer.stop();
-    }
-    else {
-
-        const auto call = m_callQueue.dequeue();
-        auto reply = call();
-        m_downloads->monitor(reply, call);
-    }
-}
-
-void FigmaGet::queueCall(const NetworkFunction& call) {
-
-    m_callQueue.enqueue(call);
-#ifndef NO_THROTTLED_CALL
-    if(!m_callTimer.isActive()) {
-        m_callTimer.start(m_throttle);
-    }
-#else
-    doCall();
-#endif
+void FigmaGet::queueCall(const NetworkFunction& call, bool isApiCall) {
+    m_scheduler->enqueue(call, isApiCall ? RequestScheduler::Kind::Api : RequestScheduler::Kind::Content);
 }
 
+// for QML that may keep it, a mapped document is copied as it could outlive the mapping
 QByteArray FigmaGet::data() const {
+    if(m_documentFile)
+        return QByteArray(m_data.constData(), m_data.size());
+    return m_data;
+}
 
+// not copied, may refer to the mapping that is released on the next dataChanged, hence parse, do not keep
+QByteArray FigmaGet::document() const {
     return m_data;
 }
 
-void FigmaGet::setError(const Id& imageRef, const QString& reason) {
-    QString type;
+QString FigmaGet::markError(const Id& imageRef) {
     switch (imageRef.type) {
     case IdType::IMAGE:
         m_images->setError(imageRef.id);
-        type = "Image";
-        break;
+        return "Image";
     case IdType::RENDERING:
         m_renderings->setError(imageRef.id);
-        type = "Rendering";
-        break;
+        return "Rendering";
     case IdType::NODE:
         m_nodes->setError(imageRef.id);
-        type = "Node";
-        break;
+        return "Node";
     }
-    emit error(QString(reason).arg(type, imageRef.id));
+    return QString();
 }
 
+void FigmaGet::setError(const Id& imageRef, const QString& reason) {
+    const auto type = markError(imageRef);
+    emit error(QString(reason).arg(type, imageRef.id));
+}
 
-
-void FigmaGet::setTimeout(const std::shared_ptr<QMetaObject::Connection>& connection, const Id& id) {
-    m_timeout->set(id.id, TimeoutTime, [this, id, connection]() {
-                if(connection.use_count() > 1)
-                    setError(id, TIMEOUT_ERR);
-            });
+// only the one id fails, the rest of the document is still fetched
+void FigmaGet::timedOut(const Id& imageRef) {
+    const auto type = markError(imageRef);
+    qWarning() << QString(TIMEOUT_ERR).arg(type, imageRef.id);
 }
 
-void FigmaGet::setTimeout(QNetworkReply* reply, const Id& id) {
-    auto connection = std::make_shared<QMetaObject::Connection>();
-    *connection = QObject::connect(reply, &QNetworkReply::finished, this, [id, this](){
-        m_timeout->cancel(id.id);
+// started when the reply is dispatched, hence time in the scheduler queue is not counted,
+// ids fail on expiry unless 'expired' handles them
+void FigmaGet::setTimeout(QNetworkReply* reply, IdType type, const QStringList& ids, const FinishedFunction& expired) {
+    Q_ASSERT(!ids.isEmpty());
+    const auto tid = asTimeoutId(ids.first());
+    m_timeout->cancel(tid); // a retried call is timed from its own dispatch
+    QObject::connect(reply, &QNetworkReply::finished, this, [tid, this](){
+        m_timeout->cancel(tid);
+    });
+    m_timeout->set(tid, TimeoutTime, [this, reply, type, ids, expired]() {
+        if(!m_replies.remove(reply))
+            return; // already cancelled
+        if(expired) {
+            expired();
+        } else {
+            for(const auto& id : ids)
+                timedOut({id, type});
+        }
+        reply->abort();
     });
-    m_timeout->set(id.id, TimeoutTime, [this, id, connection]() {
-
-                if(connection.use_count() > 1)
-                    setError(id, TIMEOUT_ERR);
-            });
 }
 
 std::tuple<int, int, int> FigmaGet::cacheInfo() const {
@@ -366,12 +517,12 @@ void FigmaGet::getImage(const QString& imageRef, const QSize& maxSize) {
     Q_ASSERT(maxSize.width() > 0 && maxSize.height() > 0);
     Q_ASSERT(!imageRef.isEmpty());
 
+    if(fromAssetCache({imageRef, IdType::IMAGE}, m_images.get(), maxSize))
+        return;
+
     if(!m_images->contains(imageRef)) {
         auto connection = std::make_shared<QMetaObject::Connection>();
-        const auto tid = Id{asTimeoutId(imageRef), IdType::IMAGE};
-        setTimeout(connection, tid);
-        *connection = QObject::connect(this, &FigmaGet::imagesPopulated, [this, connection, imageRef, maxSize, tid]() {
-            m_timeout->cancel(tid.id);
+        *connection = QObject::connect(this, &FigmaGet::imagesPopulated, [this, connection, imageRef, maxSize]() {
             QObject::disconnect(*connection);
             if(m_images->contains(imageRef)) {
                 getImage(imageRef, maxSize);
@@ -384,8 +535,9 @@ void FigmaGet::getImage(const QString& imageRef, const QSize& maxSize) {
         return;
     }
 
-    if(!m_images->isEmpty(imageRef)) {
-        emit imageReady(imageRef, m_images->data(imageRef), m_images->format(imageRef));
+    if(const auto image = m_images->committed(imageRef)) {
+        const auto& [bytes, format] = *image;
+        emit imageReady(imageRef, bytes, format);
         return;
     }
 
@@ -415,10 +567,13 @@ QNetworkReply* FigmaGet::doRetrieveImage(const Id& id, FigmaData *target, const
     request.setUrl(uri);
     request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
     auto reply = m_accessManager->get(request);
+    const auto started = Tracer::now();
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
 
-    const auto finished = [this, bytes, target, maxSize, id]() {
+    const auto finished = [this, bytes, target, maxSize, id, started]() {
+        Tracer::add("network", id.id, started);
+        MEMORY_STAGE("imageCache");
         QBuffer imageBuffer(bytes.get(), this);
         QImageReader imageReader(&imageBuffer);
         const auto format = imageReader.format();
@@ -433,40 +588,90 @@ QNetworkReply* FigmaGet::doRetrieveImage(const Id& id, FigmaData *target, const
             const auto dumpImage = imageReader.read();
             dumpImage.save("figma_+ " + id + "." + imageReader.format());
 #endif
-            if(imageReader.size().width() > maxSize.width() || imageReader.size().height() > maxSize.height()) {
-
-                const auto image = imageReader.read();
-                const auto scaled = image.scaled(maxSize, Qt::KeepAspectRatio);
-                bytes->clear();
-
-                QBuffer buffer(bytes.get(), this);
-                if(scaled.isNull() || !buffer.open(QIODevice::WriteOnly)) {
-                    setError(id, "%1 %2" + QString(" cannot be resized to %2x%3").arg(maxSize.width(), maxSize.height()));
-                    return;
-                }
-
-                QImageWriter writer(&buffer, format);
-                if(!writer.write(scaled)) {
-                    setError(id, "%1 %2" + QString(" cannot be resized %2")
-                                   .arg(writer.errorString()));
-                    return;
-                }
-                buffer.close();
+            const auto size = imageReader.size();
+            if(size.width() > maxSize.width() || size.height() > maxSize.height()) {
+                // decoding takes long for big images, not to block the event loop it is done in background
+                ++m_resizing;
+                m_imagePool->start([this, bytes, target, id, format, maxSize, scaledSize = size.scaled(maxSize, Qt::KeepAspectRatio)]() {
+                    TRACE_SPAN("image", "resize " + id.id);
+                    const auto err = resizeImage(*bytes, format, scaledSize);
+                    QMetaObject::invokeMethod(this, [this, bytes, target, id, format, maxSize, err]() {
+                        --m_resizing;
+                        if(!err.isEmpty()) {
+                            setError(id, "%1 %2" + err);
+                            return;
+                        }
+                        toAssetCache(id, maxSize, *bytes, format == "png" ? PNG : JPEG);
+                        setImage(id, target, *bytes, format == "png" ? PNG : JPEG);
+                    }, Qt::QueuedConnection);
+                });
+                return;
             }
         }
-        if(target->isEmpty(id.id) && m_connectionState == State::Loading) {  //there CAN be multiple requests within multithreaded, but we use only first
-            Q_ASSERT(format == "png" || format == "jpeg");
-            target->setBytes(id.id, *bytes, format == "png" ? PNG : JPEG);
-        }
-        Q_ASSERT(FetchFailedDebug.find(id.id) == FetchFailedDebug.end());
-        emit imageRetrieved(id.id);
+        toAssetCache(id, maxSize, *bytes, format == "png" ? PNG : JPEG);
+        setImage(id, target, *bytes, format == "png" ? PNG : JPEG);
     };
 
-    setTimeout(reply, id);
-    monitorReply(reply, bytes, finished);
+    setTimeout(reply, id.type, {id.id});
+    monitorReply(reply, bytes, finished, id.type == IdType::RENDERING ? Downloads::Renderings : Downloads::Images);
     return reply;
 }
 
+void FigmaGet::setImage(const Id& id, FigmaData* target, const QByteArray& bytes, int format) {
+    if(!target->contains(id.id))
+        return; // reset while resizing
+    if(m_connectionState == State::Loading) {  //there CAN be multiple requests within multithreaded, but we use only first
+        target->commit(id.id, bytes, format);
+    }
+    Q_ASSERT(FetchFailedDebug.find(id.id) == FetchFailedDebug.end());
+    emit imageRetrieved(id.id);
+}
+
+// images are the same in every file, renderings only in the version rendered
+QString FigmaGet::assetKey(const Id& id, const QSize& maxSize) const {
+    const auto size = QString("%1x%2").arg(maxSize.width()).arg(maxSize.height());
+    if(id.type == IdType::IMAGE)
+        return QString("image/%1/%2").arg(id.id, size);
+    if(id.type == IdType::RENDERING && !m_version.isEmpty())
+        return QString("rendering/%1/%2/%3/%4").arg(m_projectToken, m_version, id.id, size);
+    return QString();
+}
+
+// a hit saves both the API and the file server request, entries pending or failed are left as they are
+bool FigmaGet::fromAssetCache(const Id& id, FigmaData* target, const QSize& maxSize) {
+    if(!m_assetCache->isEnabled() || m_connectionState != State::Loading) // commits only while loading, as setImage
+        return false;
+    const auto entry = target->entry(id.id);
+    if(entry && (!entry->isEmpty() || entry->isPending() || entry->isError()))
+        return false;
+    const auto key = assetKey(id, maxSize);
+    if(key.isEmpty())
+        return false;
+    const auto cached = m_assetCache->find(key);
+    if(!cached)
+        return false;
+    if(!entry)
+        target->insert(id.id);
+    const auto& [bytes, format] = *cached;
+    target->commit(id.id, bytes, format);
+    emit imageRetrieved(id.id);
+    return true;
+}
+
+void FigmaGet::toAssetCache(const Id& id, const QSize& maxSize, const QByteArray& bytes, int format) {
+    if(!m_assetCache->isEnabled())
+        return;
+    const auto key = assetKey(id, maxSize);
+    if(!key.isEmpty())
+        m_assetCache->insert(key, bytes, format);
+}
+
+// recording and replaying are about the network, hence not served from the cache
+void FigmaGet::updateAssetCache() {
+    const auto capturing = m_recorder || qobject_cast<ReplayAccessManager*>(m_accessManager);
+    m_assetCache->setLimit(capturing ? 0 : qint64(m_assetCacheSize) * 1024 * 1024);
+}
+
 QNetworkReply* FigmaGet::populateImages() {
 
 
@@ -475,7 +680,7 @@ QNetworkReply* FigmaGet::populateImages() {
     QNetworkRequest request;
     request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
 
-    request.setUrl(QUrl("https://api.figma.com/v1/files/" + m_projectToken + "/images"));
+    request.setUrl(QUrl(m_apiUrl + "files/" + m_projectToken + "/images"));
     request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
 
     auto reply = m_accessManager->get(request);
@@ -518,7 +723,20 @@ QNetworkReply* FigmaGet::populateImages() {
         emit imagesPopulated();
     };
 
-    monitorReply(reply, bytes, finished);
+    // images wait for the population, without it none of them can be fetched
+    const auto tid = asTimeoutId("images");
+    m_timeout->cancel(tid);
+    QObject::connect(reply, &QNetworkReply::finished, this, [tid, this](){
+        m_timeout->cancel(tid);
+    });
+    m_timeout->set(tid, TimeoutTime, [this, reply]() {
+        if(!m_replies.remove(reply))
+            return;
+        m_populationOngoing = false;
+        reply->abort();
+        emit error("Error on populate - timeout");
+    });
+    monitorReply(reply, bytes, finished, Downloads::Images);
     return reply;
 }
 
@@ -531,13 +749,17 @@ void FigmaGet::getRendering(const QString& imageId) {
     } else  qDebug() << "getRendering" << imageId << "N/A";
     */
 
+    if(fromAssetCache({imageId, IdType::RENDERING}, m_renderings.get(),
+                      QSize(std::numeric_limits<int>::max(), std::numeric_limits<int>::max())))
+        return;
+
     if(!m_renderings->contains(imageId)) {
         auto connection = std::make_shared<QMetaObject::Connection>();
-        const auto tid = Id{asTimeoutId(imageId), IdType::RENDERING};
         m_renderings->insert(imageId);
-        setTimeout(connection, tid);
-        *connection = QObject::connect(this, &FigmaGet::imageRendered, [this, connection, imageId, tid](const QString&) {
-            m_timeout->cancel(tid.id);
+        // a rendering request times out and is retried on its own, see doRequestRendering
+        *connection = QObject::connect(this, &FigmaGet::imageRendered, [this, connection, imageId](const QString& renderedId) {
+            if(renderedId != imageId)
+                return; // renderings come in chunks, another one may be still waiting
             QObject::disconnect(*connection);
             if(m_renderings->contains(imageId)) {
                 getRendering(imageId);
@@ -549,8 +771,9 @@ void FigmaGet::getRendering(const QString& imageId) {
         return;
     }
 
-    if(!m_renderings->isEmpty(imageId)) {
-        emit renderingReady(imageId, m_renderings->data(imageId), m_renderings->format(imageId));
+    if(const auto rendering = m_renderings->committed(imageId)) {
+        const auto& [bytes, format] = *rendering;
+        emit renderingReady(imageId, bytes, format);
         return;
     }
 
@@ -565,83 +788,139 @@ void FigmaGet::getRendering(const QString& imageId) {
 }
 
 
-QNetworkReply* FigmaGet::doRequestRendering(const Id& id) {
+QNetworkReply* FigmaGet::doRequestRendering() {
 
     if(m_rendringQueue.isEmpty())
         return nullptr;
 
+    // a chunk that fits into a request, rest are requested concurrently by the next calls
+    const auto base = m_apiUrl + "images/" + m_projectToken + "?use_absolute_bounds=true&ids=";
+    QStringList ids;
+    auto length = base.length();
+    while(!m_rendringQueue.isEmpty() && ids.size() < MaxRenderingChunk) {
+        const auto idLength = QUrl::toPercentEncoding(m_rendringQueue.first()).length() + 3; // + encoded ','
+        if(!ids.isEmpty() && length + idLength > MaxUrlLength)
+            break;
+        length += idLength;
+        ids.append(m_rendringQueue.takeFirst());
+    }
+    if(!m_rendringQueue.isEmpty())
+        requestRendering({QString(), IdType::RENDERING});
+
     QNetworkRequest request;
     request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
 
-    const QStringList params{
-        "ids=" + m_rendringQueue.join(','),
-        "use_absolute_bounds=true"
-    };
-    m_rendringQueue.clear();
-
-    request.setUrl(QUrl("https://api.figma.com/v1/images/" + m_projectToken + "?" + params.join('&')));
+    request.setUrl(QUrl(base + ids.join(',')));
     request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
     request.setHeader(QNetworkRequest::ContentLengthHeader, 0);
 
     auto reply = m_accessManager->get(request);
+    const auto started = Tracer::now();
+    QElapsedTimer latency;
+    latency.start();
     std::shared_ptr<QByteArray> bytes(new QByteArray);
 
-
-    QObject::connect(reply, &QNetworkReply::destroyed, this, [this](QObject*) {
-           if(!m_rendringQueue.isEmpty()) {
-               requestRendering({QString(), IdType::RENDERING}); // type has no meaning
-           }
+    QObject::connect(reply, &QNetworkReply::errorOccurred, this, [ids](const auto err) {
+        qDebug() << "doRequestRendering" << ids << " error" << err;
     });
 
 
-    QObject::connect(reply, &QNetworkReply::errorOccurred, this, [id](const auto err) {
-        qDebug() << "doRequestRendering" << id.id << enumToString(id.type)  << " error" << err;
-    });
-
-    const auto finished =  [this, bytes, id]() {
+    const auto finished =  [this, bytes, ids, started, latency]() {
+        addRenderingStats(ids.size(), latency.elapsed());
+        Tracer::add("network", "renderings " + ids.join(','), started);
         if(bytes->isEmpty()) {
-           setError(id, "%1 \"%2\" Error - no data");
+           retryRenderings(ids, "%1 \"%2\" Error - no data");
            return;
         }
         QJsonParseError err;
         const auto doc = QJsonDocument::fromJson(*bytes, &err);
         if(err.error != QJsonParseError::NoError) {
-           setError(id, "%1 \"%2\"" + QString("Error on rendering - JSON: %1 at %2")
-                    .arg(err.errorString(), err.offset));
+           retryRenderings(ids, "%1 \"%2\"" + QString("Error on rendering - JSON: %1 at %2")
+                    .arg(err.errorString()).arg(err.offset));
             // this has bug in MSVC qDebug() << "JSON - size:" << bytes->size() << "dump: " << (bytes ? *bytes : "N/A");
             return;
         }
         const auto obj = doc.object();
         if(obj["error"].toBool()) {
-            setError(id, "%1 \"%2\"" + QString("Status %1").arg(obj["status"].toString()));
+            retryRenderings(ids, "%1 \"%2\"" + QString("Status %1").arg(obj["status"].toString()));
         } else {
             const auto renderings = obj["images"].toObject();
-            for(const auto& key : renderings.keys()) {
-                if(renderings[key].toString().isEmpty()) {
-                    setError(id, "%1 \"%2\"" + QString("Invalid URL key:\"%1\"").arg(key));
-                    break;
+            QStringList failed;
+            for(const auto& key : ids) {
+                const auto url = renderings[key].toString();
+                if(url.isEmpty()) { // not rendered, e.g. it took too long
+                    failed.append(key);
+                    continue;
                 }
-                m_renderings->setUrl(key, renderings[key].toString());
+                m_renderingRetries.remove(key);
+                m_renderings->setUrl(key, url);
                 emit imageRendered(key);
             }
+            if(!failed.isEmpty())
+                retryRenderings(failed, "%1 \"%2\" Not rendered");
         }
     };
-    setTimeout(reply, id);
-    monitorReply(reply, bytes, finished);
+    // a stuck rendering job shall not block others, its ids are requested again
+    setTimeout(reply, IdType::RENDERING, ids, [this, ids]() {
+        retryRenderings(ids, TIMEOUT_ERR);
+    });
+    monitorReply(reply, bytes, finished, Downloads::Renderings);
+    // a throttled or failed chunk puts its ids back, a call retried by the scheduler takes them from the queue
+    m_replies[reply].failed = [this, ids](const QString& reason) {
+        retryRenderings(ids, "%1 \"%2\" " + reason);
+    };
     return reply;
 }
 
-void FigmaGet::replyCompleted(const std::shared_ptr<QByteArray>& bytes) {
-    const auto checksum = qChecksum(bytes->constData(), bytes->length());
-    if(checksum != m_checksum || m_connectionState == State::Error) {
+void FigmaGet::retryRenderings(const QStringList& ids, const QString& reason) {
+    for(const auto& id : ids) {
+        if(++m_renderingRetries[id] > MaxRenderingRetries) {
+            // only this rendering is missing, the others are still retried
+            m_renderingStats["failed"] = m_renderingStats["failed"].toInt() + 1;
+            m_renderingRetries.remove(id);
+            const auto type = markError({id, IdType::RENDERING});
+            qWarning() << QString(reason).arg(type, id);
+            emit imageRendered(id); // release the waiting getRendering
+            continue;
+        }
+        m_renderingStats["retried"] = m_renderingStats["retried"].toInt() + 1;
+        m_rendringQueue.append(id);
+    }
+    if(!m_rendringQueue.isEmpty())
+        requestRendering({QString(), IdType::RENDERING});
+    emit renderingStatsChanged();
+}
+
+void FigmaGet::addRenderingStats(int ids, qint64 ms) {
+    const auto chunks = m_renderingStats["chunks"].toInt() + 1;
+    const auto totalMs = m_renderingStats["totalMs"].toLongLong() + ms;
+    m_renderingStats["chunks"] = chunks;
+    m_renderingStats["ids"] = m_renderingStats["ids"].toInt() + ids;
+    m_renderingStats["totalMs"] = totalMs;
+    m_renderingStats["averageMs"] = totalMs / chunks;
+    m_renderingStats["maxMs"] = std::max(m_renderingStats["maxMs"].toLongLong(), ms);
+    m_renderingStats["lastMs"] = ms;
+    emit renderingStatsChanged();
+}
+
+QVariantMap FigmaGet::renderingStats() const {
+    return m_renderingStats;
+}
+
+void FigmaGet::replyCompleted(const std::shared_ptr<QByteArray>& bytes, const QString& version) {
+    if(version.isEmpty() || version != m_version || m_dataScope != m_scope || m_connectionState == State::Error) {
         m_connectionState = State::Loading;
         m_downloads->reset();
-        m_downloads->setProgress(nullptr, bytes->length(), bytes->length());
-        m_checksum = checksum;
+        m_downloads->setProgress(nullptr, bytes->length(), bytes->length(), Downloads::Document);
+        m_version = version;
+        m_dataScope = m_scope;
         m_data.swap(*bytes);
+        bytes->clear(); // may refer to the mapping released below
+        m_documentFile = std::move(m_receivedFile);
         emit dataChanged();
         emit updateCompleted(true);
     } else {
+         m_receivedFile.reset();
          emit updateCompleted(false);
     }
 }
@@ -654,29 +933,176 @@ void FigmaGet::update() {
         return;
     }
 
+    // the document can be huge, hence its version is checked first with a shallow request
+    QNetworkRequest request;
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
+
+    // a scoped fetch needs also the elements of pages to find their ids
+    request.setUrl(QUrl(m_apiUrl + "files/" + m_projectToken + (m_scope.isEmpty() ? "?depth=1" : "?depth=2")));
+    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+
+    std::shared_ptr<QByteArray> bytes(new QByteArray);
+    auto reply = m_accessManager->get(request);
+    const auto started = Tracer::now();
+
+    const auto finished =  [this, bytes, started]() {
+        Tracer::add("network", "version", started);
+        QJsonParseError err;
+        const auto doc = QJsonDocument::fromJson(*bytes, &err);
+        const auto version = err.error == QJsonParseError::NoError ? doc.object()["version"].toString() : QString();
+        if(!version.isEmpty() && version == m_version && m_dataScope == m_scope && !m_data.isEmpty() && m_connectionState != State::Error) {
+            emit updateCompleted(false);
+            return;
+        }
+        if(!m_scope.isEmpty() && !version.isEmpty())
+            fetchScoped(doc.object(), version);
+        else
+            fetchDocument(version);
+    };
+
+    monitorReply(reply, bytes, finished, Downloads::Document, false);
+}
+
+void FigmaGet::fetchDocument(const QString& version) {
     QNetworkRequest request;
     request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
 
     const QStringList params{
         {"geometry=paths"}
     };
-    request.setUrl(QUrl("https://api.figma.com/v1/files/" + m_projectToken + QChar('?') + params.join('&')));
+    request.setUrl(QUrl(m_apiUrl + "files/" + m_projectToken + QChar('?') + params.join('&')));
     request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
     auto reply = m_accessManager->get(request);
-
-    const auto finished =  [reply, this, bytes]() {
+    const auto started = Tracer::now();
+
+    // the document can be hundreds of megabytes, it is written to disk as it arrives and then
+    // mapped, so its bytes are not held on heap and the parsed DOM is the only copy in RAM
+    auto file = std::make_shared<QTemporaryFile>();
+    const auto streamed = file->open();
+
+    const auto finished =  [reply, this, bytes, started, version, file, streamed]() {
+        Tracer::add("network", "document", started);
+        if(streamed) {
+            file->flush();
+            const auto size = file->size();
+            const auto mapped = size > 0 ? file->map(0, size) : nullptr;
+            if(mapped) {
+                *bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), size);
+                m_receivedFile = file;
+            } else {
+                file->seek(0);
+                *bytes = file->readAll();
+            }
+        }
         reply->deleteLater();
-        QObject::connect(reply, &QObject::destroyed, this, [this, bytes] (QObject*) { //since added after downloads, this is called after
-            emit replyComplete(bytes);
+        QObject::connect(reply, &QObject::destroyed, this, [this, bytes, version] (QObject*) { //since added after downloads, this is called after
+            emit replyComplete(bytes, version);
         });
     };
 
-    monitorReply(reply, bytes, finished, m_checksum == 0);
+    monitorReply(reply, bytes, finished, Downloads::Document, m_version.isEmpty(), streamed ? file : nullptr);
 
 }
 
+void FigmaGet::setScope(const QMap<int, QSet<int>>& scope) {
+    m_scope = scope;
+}
+
+void FigmaGet::fetchScoped(const QJsonObject& skeleton, const QString& version) {
+    QStringList ids;
+    const auto pages = skeleton["document"].toObject()["children"].toArray();
+    for(const auto& [canvas, elements] : m_scope.asKeyValueRange()) {
+        if(canvas < 1 || canvas > pages.size())
+            continue;
+        const auto page = pages[canvas - 1].toObject();
+        if(elements.isEmpty()) {
+            ids.append(page["id"].toString());
+            continue;
+        }
+        const auto children = page["children"].toArray();
+        for(const auto element : elements) {
+            if(element >= 1 && element <= children.size())
+                ids.append(children[element - 1].toObject()["id"].toString());
+        }
+    }
+
+    if(ids.isEmpty()) {
+        emit error("Nothing to fetch, scope does not match any page or view");
+        emit updateCompleted(false);
+        return;
+    }
+
+    // as many ids as fit into one request
+    const auto maxLength = MaxUrlLength - (m_apiUrl + "files/" + m_projectToken + "/nodes?geometry=paths&ids=").length();
+    QVector<QStringList> chunks{{}};
+    auto length = 0;
+    for(const auto& id : ids) {
+        const auto idLength = QUrl::toPercentEncoding(id).length() + 3; // + encoded ','
+        if(!chunks.last().isEmpty() && length + idLength > maxLength) {
+            chunks.append(QStringList());
+            length = 0;
+        }
+        length += idLength;
+        chunks.last().append(id);
+    }
+
+    const auto fetch = std::make_shared<ScopedFetch>(ScopedFetch{skeleton, version, static_cast<int>(chunks.size()), {}, {}, {}, {}});
+    for(const auto& chunk : chunks) {
+        queueCall([this, fetch, chunk]() {
+            return doFetchScoped(fetch, chunk);
+        });
+    }
+}
+
+QNetworkReply* FigmaGet::doFetchScoped(const std::shared_ptr<ScopedFetch>& fetch, const QStringList& ids) {
+    QNetworkRequest request;
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
+
+    request.setUrl(QUrl(m_apiUrl + "files/" + m_projectToken + "/nodes?geometry=paths&ids=" + ids.join(',')));
+    request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
+
+    std::shared_ptr<QByteArray> bytes(new QByteArray);
+    auto reply = m_accessManager->get(request);
+    const auto started = Tracer::now();
+
+    const auto finished =  [reply, this, bytes, started, fetch, ids]() {
+        Tracer::add("network", "scoped " + ids.join(','), started);
+        QJsonParseError err;
+        const auto doc = QJsonDocument::fromJson(*bytes, &err);
+        if(err.error != QJsonParseError::NoError) {
+            emit error(QString("Error on scoped fetch - JSON: %1 at %2").arg(err.errorString()).arg(err.offset));
+            return;
+        }
+        const auto nodes = doc.object()["nodes"].toObject();
+        for(const auto& id : ids) {
+            const auto node = nodes[id].toObject();
+            if(node.isEmpty()) {
+                qWarning() << QString("Scoped node cannot be retrieved \"%1\", kept shallow").arg(id);
+                continue;   // stays as a shallow element
+            }
+            fetch->subtrees.insert(id, node["document"].toObject());
+            for(const auto& [target, key] : {std::make_pair(&fetch->components, "components"),
+                                             std::make_pair(&fetch->componentSets, "componentSets"),
+                                             std::make_pair(&fetch->styles, "styles")}) {
+                const auto values = node[key].toObject();
+                for(auto it = values.begin(); it != values.end(); ++it)
+                    target->insert(it.key(), it.value());
+            }
+        }
+        if(--fetch->pending > 0)
+            return;
+        reply->deleteLater();
+        QObject::connect(reply, &QObject::destroyed, this, [this, fetch] (QObject*) { //since added after downloads, this is called after
+            emit replyComplete(std::make_shared<QByteArray>(fetch->document()), fetch->version);
+        });
+    };
+
+    monitorReply(reply, bytes, finished, Downloads::Document, m_version.isEmpty());
+    return reply;
+}
+
 void FigmaGet::documentCreated() {
 
     m_connectionState = State::Complete;
@@ -685,80 +1111,115 @@ void FigmaGet::documentCreated() {
 void FigmaGet::getNode(const QString &id) {
 
     if(!m_nodes->contains(id)) {
-        const QStringList params{
-            "ids=" + id,
-            "geometry=paths"
-        };
         m_nodes->insert(id);
-        m_nodes->setUrl(id, "https://api.figma.com/v1/files/" + m_projectToken + "/nodes?" + params.join('&'));
     }
 
-    if(!m_nodes->isEmpty(id)) {
-        emit nodeReady(m_nodes->data(id));
+    if(const auto node = m_nodes->committed(id)) {
+        emit nodeReady(std::get<QByteArray>(*node));
         return;
     }
 
-    if(m_nodes->setPending(id))
+    if(m_nodes->isError(id) || !m_nodes->setPending(id))
         return; // already on its way
 
-    retrieveNode({id, IdType::NODE});
+    m_nodeQueue.append(id);
+    retrieveNodes();
 }
 
-void FigmaGet::doRetrieveNode(const Id& id) {
-
+QNetworkReply* FigmaGet::doRetrieveNodes(QStringList& batch) {
+
+    // as many ids as fit into one request, the rest goes to the next one
+    const auto base = m_apiUrl + "files/" + m_projectToken + "/nodes?geometry=paths&ids=";
+    if(batch.isEmpty()) {
+        auto length = base.length();
+        while(!m_nodeQueue.isEmpty()) {
+            const auto idLength = QUrl::toPercentEncoding(m_nodeQueue.first()).length() + 3; // + encoded ','
+            if(!batch.isEmpty() && length + idLength > MaxUrlLength)
+                break;
+            length += idLength;
+            batch.append(m_nodeQueue.takeFirst());
+        }
+        if(!m_nodeQueue.isEmpty())
+            retrieveNodes();
+    }
+    if(batch.isEmpty())
+        return nullptr;
+    const auto ids = batch;
 
     QNetworkRequest request;
     request.setAttribute(QNetworkRequest::Http2AllowedAttribute, false);
 
-    const auto uri = m_nodes->url(id.id);
-    request.setUrl(uri);
+    request.setUrl(QUrl(base + ids.join(',')));
     request.setRawHeader("X-Figma-Token", m_userToken.toLatin1());
 
     auto reply = m_accessManager->get(request);
+    const auto started = Tracer::now();
 
     std::shared_ptr<QByteArray> bytes(new QByteArray);
 
-    const auto finished = [this, bytes, id] () {
-        if(m_connectionState == State::Loading)
-            m_nodes->setBytes(id.id, *bytes);
-        emit nodeRetrieved(id.id);
+    const auto finished = [this, bytes, ids, started] () {
+        Tracer::add("network", "nodes " + ids.join(','), started);
+        QJsonParseError err;
+        const auto doc = QJsonDocument::fromJson(*bytes, &err);
+        if(err.error != QJsonParseError::NoError) {
+            setError({ids.first(), IdType::NODE}, "%1 \"%2\"" + QString("Error on nodes - JSON: %1 at %2")
+                     .arg(err.errorString()).arg(err.offset));
+            return;
+        }
+        // split back into per id responses, as if each were requested alone
+        const auto nodes = doc.object()["nodes"].toObject();
+        for(const auto& id : ids) {
+            const auto node = nodes[id];
+            const auto entry = m_nodes->entry(id);
+            if(m_connectionState == State::Loading && node.isObject() && entry && entry->isPending()) {
+                const QJsonObject single{{"nodes", QJsonObject{{id, node}}}};
+                m_nodes->setBytes(id, QJsonDocument(single).toJson(QJsonDocument::Compact));
+            }
+            emit nodeRetrieved(id);
+        }
     };
 
-    setTimeout(reply, id);
-    monitorReply(reply, bytes, finished);
+    setTimeout(reply, IdType::NODE, ids);
+    monitorReply(reply, bytes, finished, Downloads::Nodes);
+    return reply;
 }
 
 
-void FigmaGet::replyReader() {
-
-    const auto replies = m_replies.keys();
-    for(auto& reply : replies)
-    {
-        if(reply->bytesAvailable()) {
-            auto data = std::get<std::shared_ptr<QByteArray>>(m_replies[reply]);
-            *data += reply->readAll();
-            //qDebug() << "F00" << reply << data->size();
+bool FigmaGet::readReply(QNetworkReply* reply) {
+    const auto request = m_replies.find(reply);
+    if(request == m_replies.end())
+        return false; // cancelled
+    const auto stream = request->stream;
+    if(!stream) {
+        *request->bytes += reply->readAll();
+        return true;
+    }
+    char buffer[StreamBufferSize];
+    qint64 len;
+    while((len = reply->read(buffer, sizeof(buffer))) > 0) {
+        if(stream->write(buffer, len) != len) {
+            emit error("Cannot write document: " + stream->errorString());
+            m_replies.remove(reply);
+            reply->abort();
+            return false;
         }
     }
+    return true;
 }
 
-void FigmaGet::onReplyError(QNetworkReply::NetworkError err) {
-    const auto keys = m_replies.keys();
-    const auto it = std::find_if(keys.begin(), keys.end(), [err](const auto r) {
-        return r->error() == err;
-    });
-    if(it == keys.end())
+void FigmaGet::onReplyError(QNetworkReply* reply, QNetworkReply::NetworkError err) {
+    if(!m_replies.contains(reply))
+        return; // cancelled or timed out
+    if(const auto failed = m_replies[reply].failed; failed && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).isValid()) {
+        m_replies.remove(reply);
+        failed(reply->errorString());
         return;
-    const auto reply = *it;
+    }
     if(err == QNetworkReply::UnknownContentError || err == QNetworkReply::ProtocolInvalidOperationError) { //Too Many Requests
         const auto statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
         const auto code = statusCode.isValid() ? statusCode.toInt() : -1;
         if(code == 429 || code == 400) {
-            emit m_downloads->tooManyRequests();
-            const auto failedCall = m_downloads->monitored(reply);
-            QTimer::singleShot(ImageRetry, this, [this, failedCall]() { //figma doc says about one minute
-                queueCall(failedCall);
-            });
+            // scheduler has already queued it again
         }  else {
             emit error("HTTP error: " + reply->errorString());
         }
@@ -773,14 +1234,56 @@ void FigmaGet::onReplyError(QNetworkReply::NetworkError err) {
     m_replies.remove(reply);
 }
 
+void FigmaGet::recordReply(QNetworkReply* reply, const Request& request) {
+    if(!m_recorder)
+        return;
+    if(request.stream)
+        m_recorder->record(reply, request.elapsed.elapsed(), *request.stream);
+    else
+        m_recorder->record(reply, request.elapsed.elapsed(), *request.bytes);
+}
+
+bool FigmaGet::record(const QString& dirName) {
+    auto recorder = std::make_unique<TrafficRecorder>(dirName);
+    if(!recorder->isValid()) {
+        emit error("Cannot record to " + dirName + ": " + recorder->errorString());
+        return false;
+    }
+    m_recorder = std::move(recorder);
+    updateAssetCache();
+    return true;
+}
+
+// responses are served from a recording, otherwise it works as is
+bool FigmaGet::replay(const QString& dirName) {
+    auto manager = new ReplayAccessManager(dirName, this);
+    if(!manager->isValid()) {
+        emit error("Cannot replay " + dirName + ": " + manager->errorString());
+        delete manager;
+        return false;
+    }
+    m_accessManager->deleteLater();
+    m_accessManager = manager;
+    m_accessManager->setAutoDeleteReplies(true);
+    QObject::connect(m_accessManager, &QNetworkAccessManager::finished, this, &FigmaGet::doFinished, Qt::UniqueConnection);
+    updateAssetCache();
+    return true;
+}
+
 void FigmaGet::monitorReply(QNetworkReply* reply,
                             const std::shared_ptr<QByteArray>& bytes,
                             const std::function<void ()>& finalize,
-                            bool showProgress) {
+                            Downloads::Category category,
+                            bool showProgress,
+                            const std::shared_ptr<QTemporaryFile>& stream) {
     Q_ASSERT(!m_replies.contains(reply));
-    m_replies.insert(reply, {bytes, finalize});
+    m_replies.insert(reply, {bytes, finalize, stream, {}});
+    m_replies[reply].elapsed.start();
 
-    QObject::connect(reply, &QNetworkReply::errorOccurred, this, &FigmaGet::onReplyError, Qt::QueuedConnection);
+    QObject::connect(reply, &QNetworkReply::errorOccurred, this, [this, reply = QPointer<QNetworkReply>(reply)](QNetworkReply::NetworkError err) {
+        if(reply)
+            onReplyError(reply, err);
+    }, Qt::QueuedConnection);
 
 #ifndef NO_SSL
     QObject::connect(reply, &QNetworkReply::sslErrors,
@@ -791,12 +1294,14 @@ void FigmaGet::monitorReply(QNetworkReply* reply,
 #endif
 
     if(showProgress) {
-        QObject::connect(reply, &QNetworkReply::downloadProgress, this, [reply, this] (qint64 bytesReceived, qint64 bytesTotal) {
-            m_downloads->setProgress(reply, bytesReceived, bytesTotal);
+        QObject::connect(reply, &QNetworkReply::downloadProgress, this, [reply, category, this] (qint64 bytesReceived, qint64 bytesTotal) {
+            m_downloads->setProgress(reply, bytesReceived, bytesTotal, category);
         });
     }
 
-    QObject::connect(reply, &QNetworkReply::readyRead, this, &FigmaGet::replyReader, Qt::QueuedConnection);
+    QObject::connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        readReply(reply);
+    });
 }
 
 Downloads* FigmaGet::downloadProgress() {
@@ -806,25 +1311,16 @@ Downloads* FigmaGet::downloadProgress() {
 
 
 std::optional<std::tuple<QByteArray, int>> FigmaGet::cachedImage(const QString& imageRef) {
-    if(!m_images->contains(imageRef) ||
-            m_images->isEmpty(imageRef) ||
-            m_images->isPending(imageRef))
-        return std::nullopt;
-    return std::make_optional(std::make_tuple(m_images->data(imageRef), m_images->format(imageRef)));
+    return m_images->committed(imageRef);
 }
 
 std::optional<std::tuple<QByteArray, int>> FigmaGet::cachedRendering(const QString& figmaId) {
-    if(!m_renderings->contains(figmaId) ||
-            m_renderings->isEmpty(figmaId) ||
-            m_renderings->isPending(figmaId))
-        return std::nullopt;
-    return std::make_optional(std::make_tuple(m_renderings->data(figmaId), m_renderings->format(figmaId)));
+    return m_renderings->committed(figmaId);
 }
 
 std::optional<QByteArray> FigmaGet::cachedNode(const QString& figmaId) {
-    if(!m_nodes->contains(figmaId) ||
-            m_nodes->isEmpty(figmaId) ||
-            m_nodes->isPending(figmaId))
+    const auto node = m_nodes->committed(figmaId);
+    if(!node)
         return std::nullopt;
-    return std::make_optional(m_nodes->data(figmaId));
+    return std::make_optional(std::get<QByteArray>(*node));
 }
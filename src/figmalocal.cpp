@@ -0,0 +1,308 @@
+#include "figmalocal.h"
+#include "figmadata.h"
+#include "figmastore.h"
+#include "tracer.h"
+#include "networkreplay.h"
+#include <QQmlEngine>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QBuffer>
+#include <QImageReader>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+
+enum Format {
+    None = 0, JPEG, PNG
+};
+
+FigmaLocal::FigmaLocal(QObject* parent) : FigmaProvider(parent),
+    m_archiveImages(new FigmaData),
+    m_archiveRenderings(new FigmaData),
+    m_archiveNodes(new FigmaData),
+    m_images(new FigmaData),
+    m_renderings(new FigmaData),
+    m_nodes(new FigmaData) {
+    qmlRegisterUncreatableType<FigmaLocal>("FigmaGet", 1, 0, "FigmaLocal", "");
+}
+
+FigmaLocal::~FigmaLocal() {
+}
+
+QString FigmaLocal::fileName(const QString& id) {
+    return QString::fromLatin1(QUrl::toPercentEncoding(id));
+}
+
+bool FigmaLocal::restore(const QString& path) {
+    reset();
+    m_archiveImages->clear();
+    m_archiveRenderings->clear();
+    m_archiveNodes->clear();
+    m_path.clear();
+    m_data.clear();
+
+    if(!QFileInfo(path).isDir())
+        return readArchive(path);
+    if(TrafficRecorder::isRecording(path))
+        return readRecording(path);
+
+    QFile file(path + "/document.json");
+    if(!file.open(QIODevice::ReadOnly)) {
+        emit error("Restore error: " + file.errorString() + " " + file.fileName());
+        return false;
+    }
+    m_path = path;
+    m_data = file.readAll();
+    emit restored(0, {});
+    return true;
+}
+
+bool FigmaLocal::readArchive(const QString& filename) {
+    if(FigmaStore::isStore(filename)) {
+        auto store = std::make_shared<FigmaStore>();
+        const auto data = store->open(filename) ? store->load(FigmaStore::Document, {}) : std::nullopt;
+        if(!data) {
+            emit error("Restore error: " + store->errorString());
+            return false;
+        }
+        m_data = *data;
+        m_archiveImages->read(store, FigmaStore::Images);
+        m_archiveRenderings->read(store, FigmaStore::Renderings);
+        m_archiveNodes->read(store, FigmaStore::Nodes);
+        emit restored(store->meta().flags, store->meta().imports);
+        return true;
+    }
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly)) {
+        emit error("Restore error: " + file.errorString() + " "  + filename);
+        return false;
+    }
+    QDataStream stream(&file);
+    const auto meta = FigmaStore::readLegacy(stream, m_data);
+    if(!meta) {
+        emit error("Restore failed on " + filename);
+        return false;
+    }
+    m_archiveImages->read(stream);
+    m_archiveRenderings->read(stream);
+    m_archiveNodes->read(stream);
+
+    if(stream.status() != QDataStream::Ok) {
+        emit error("Restore file corrupted, " + filename);
+        return false;
+    }
+    emit restored(meta->flags, meta->imports);
+    return true;
+}
+
+// a recording is keyed by urls, it is turned into ids as FigmaGet does with the responses
+bool FigmaLocal::readRecording(const QString& dirName) {
+    const QDir dir(dirName);
+    QString errorString;
+    const auto responses = TrafficRecorder::read(dir, errorString);
+    if(!responses) {
+        emit error("Restore error: " + errorString);
+        return false;
+    }
+    static const QRegularExpression documentPath(R"(/files/[^/]+$)");
+    static const QRegularExpression imagesPath(R"(/files/[^/]+/images$)");
+    static const QRegularExpression nodesPath(R"(/files/[^/]+/nodes$)");
+    static const QRegularExpression renderingsPath(R"(/images/[^/]+$)");
+    QHash<QString, QString> bodies; // url -> body file, the last successful one
+    QHash<QString, QString> imageUrls;
+    QHash<QString, QString> renderingUrls;
+    for(const auto& response : *responses) {
+        if(response.status != 200 || response.error != 0)
+            continue;
+        const QUrl url(response.url);
+        const auto path = url.path();
+        const auto isApi = documentPath.match(path).hasMatch() || imagesPath.match(path).hasMatch()
+                || nodesPath.match(path).hasMatch() || renderingsPath.match(path).hasMatch();
+        if(!isApi) {
+            bodies.insert(url.toString(), response.body);
+            continue;
+        }
+        QFile file(dir.filePath(response.body));
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+        const auto bytes = file.readAll();
+        if(documentPath.match(path).hasMatch()) {
+            if(!QUrlQuery(url).hasQueryItem("depth")) // not a version probe
+                m_data = bytes;
+            continue;
+        }
+        QJsonParseError err;
+        const auto obj = QJsonDocument::fromJson(bytes, &err).object();
+        if(err.error != QJsonParseError::NoError) {
+            bodies.insert(url.toString(), response.body); // e.g. an image server path alike
+            continue;
+        }
+        if(imagesPath.match(path).hasMatch()) {
+            const auto images = obj["meta"].toObject()["images"].toObject();
+            for(auto it = images.begin(); it != images.end(); ++it)
+                imageUrls.insert(it.key(), it.value().toString());
+        } else if(renderingsPath.match(path).hasMatch()) {
+            const auto images = obj["images"].toObject();
+            for(auto it = images.begin(); it != images.end(); ++it)
+                renderingUrls.insert(it.key(), it.value().toString());
+        } else {
+            const auto nodes = obj["nodes"].toObject();
+            for(auto it = nodes.begin(); it != nodes.end(); ++it) {
+                const QJsonObject single{{"nodes", QJsonObject{{it.key(), it.value()}}}};
+                if(!m_archiveNodes->contains(it.key()))
+                    m_archiveNodes->insert(it.key());
+                m_archiveNodes->commit(it.key(), QJsonDocument(single).toJson(QJsonDocument::Compact));
+            }
+        }
+    }
+    if(m_data.isEmpty()) {
+        emit error("Restore error: no document in the recording " + dirName);
+        return false;
+    }
+    for(const auto& [urls, archive] : {std::make_pair(&imageUrls, m_archiveImages.get()),
+                                       std::make_pair(&renderingUrls, m_archiveRenderings.get())}) {
+        for(auto it = urls->constBegin(); it != urls->constEnd(); ++it) {
+            const auto body = bodies.constFind(QUrl(it.value()).toString());
+            if(body == bodies.constEnd())
+                continue; // not fetched while recording
+            QFile file(dir.filePath(*body));
+            if(!file.open(QIODevice::ReadOnly))
+                continue;
+            auto bytes = file.readAll();
+            const auto format = imageFormat(bytes);
+            if(format == None)
+                continue;
+            archive->insert(it.key());
+            archive->commit(it.key(), bytes, format);
+        }
+    }
+    emit restored(0, {});
+    return true;
+}
+
+int FigmaLocal::imageFormat(QByteArray& bytes) {
+    QBuffer buffer(&bytes);
+    const auto format = QImageReader::imageFormat(&buffer);
+    if(format == "png")
+        return PNG;
+    if(format == "jpeg" || format == "jpg")
+        return JPEG;
+    return None;
+}
+
+QByteArray FigmaLocal::data() const {
+    return m_data;
+}
+
+std::optional<std::tuple<QByteArray, int>> FigmaLocal::load(Kind kind, const QString& id) const {
+    if(m_path.isEmpty()) {
+        const auto archive = kind == Kind::Image ? m_archiveImages.get()
+                                : kind == Kind::Rendering ? m_archiveRenderings.get()
+                                : m_archiveNodes.get();
+        return archive->committed(id);
+    }
+
+    const auto folder = kind == Kind::Image ? "/images/" : kind == Kind::Rendering ? "/renderings/" : "/nodes/";
+    QFile file(m_path + folder + fileName(id) + (kind == Kind::Node ? ".json" : ""));
+    if(!file.open(QIODevice::ReadOnly))
+        return std::nullopt;
+    auto bytes = file.readAll();
+    if(kind == Kind::Node)
+        return std::make_tuple(bytes, 0);
+    const auto format = imageFormat(bytes);
+    if(format == None)
+        return std::nullopt;
+    return std::make_tuple(bytes, format);
+}
+
+// false if already there or on its way
+bool FigmaLocal::get(Kind kind, const QString& id, FigmaData* cache) {
+    const auto entry = cache->entry(id);
+    if(!entry)
+        cache->insert(id);
+    else if(!entry->isEmpty() || entry->isError())
+        return false;
+    if(!cache->setPending(id))
+        return false;
+    ++m_pending;
+    QTimer::singleShot(m_latency, this, [this, kind, id, cache]() {
+        --m_pending;
+        const auto current = cache->entry(id);
+        if(!current || !current->isPending())
+            return; // reset meanwhile
+        TRACE_SPAN("local", id);
+        const auto item = load(kind, id);
+        if(!item) {
+            cache->setError(id);
+            emit error(QString("%1 not found \"%2\"")
+                       .arg(kind == Kind::Image ? "Image" : kind == Kind::Rendering ? "Rendering" : "Node", id));
+            return;
+        }
+        const auto& [bytes, format] = *item;
+        cache->setBytes(id, bytes, format);
+        switch(kind) {
+        case Kind::Image: emit imageReady(id, bytes, format); break;
+        case Kind::Rendering: emit renderingReady(id, bytes, format); break;
+        case Kind::Node: emit nodeReady(id); break;
+        }
+    });
+    return true;
+}
+
+bool FigmaLocal::isReady() {
+    return m_pending == 0;
+}
+
+std::optional<std::tuple<QByteArray, int>> FigmaLocal::cachedImage(const QString& imageRef) {
+    return m_images->committed(imageRef);
+}
+
+std::optional<std::tuple<QByteArray, int>> FigmaLocal::cachedRendering(const QString& figmaId) {
+    return m_renderings->committed(figmaId);
+}
+
+std::optional<QByteArray> FigmaLocal::cachedNode(const QString& figmaId) {
+    const auto node = m_nodes->committed(figmaId);
+    if(!node)
+        return std::nullopt;
+    return std::make_optional(std::get<QByteArray>(*node));
+}
+
+// images are served as they are stored, hence maxSize is not applied
+void FigmaLocal::getImage(const QString& imageRef, const QSize&) {
+    if(get(Kind::Image, imageRef, m_images.get()))
+        return;
+    if(const auto image = m_images->committed(imageRef)) {
+        const auto& [bytes, format] = *image;
+        emit imageReady(imageRef, bytes, format);
+    }
+}
+
+void FigmaLocal::getRendering(const QString& figmaId) {
+    if(get(Kind::Rendering, figmaId, m_renderings.get()))
+        return;
+    if(const auto rendering = m_renderings->committed(figmaId)) {
+        const auto& [bytes, format] = *rendering;
+        emit renderingReady(figmaId, bytes, format);
+    }
+}
+
+void FigmaLocal::getNode(const QString& figmaId) {
+    if(!get(Kind::Node, figmaId, m_nodes.get()) && !m_nodes->isEmpty(figmaId))
+        emit nodeReady(figmaId);
+}
+
+std::tuple<int, int, int> FigmaLocal::cacheInfo() const {
+    return {m_images->size(), m_renderings->size(), m_nodes->size()};
+}
+
+void FigmaLocal::reset() {
+    m_images->clear();
+    m_renderings->clear();
+    m_nodes->clear();
+}
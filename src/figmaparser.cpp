@@ -1,6 +1,8 @@
 
 #include "figmaparser.h"
 #include "utils.h"
+#include "tracer.h"
+#include "memorystats.h"
 #include <QJsonDocument>
 #include <QRegularExpression>
 #include <QJsonArray>
@@ -139,14 +141,19 @@ std::optional<FigmaParser::ItemType> FigmaParser::type(const QJsonObject& obj) {
 
 
 std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject& project, FigmaParserData& data) {
+        TRACE_SPAN("phase", "components");
+        TRACE_TOTALS("node");
+        MEMORY_STAGE("components");
         Components map; 
         auto componentObjects = getObjectsByType(project["document"].toObject(), "COMPONENT");
         const auto components = project["components"].toObject();
+        QStringList missing;
         for (const auto& key : components.keys()) {
             if(!componentObjects.contains(key)) {
                 const auto response = data.nodeData(key);
                 if(response.isEmpty()) {
-                    ERR(toStr("Component not found", key, "for"))
+                    missing.append(key); // ask all missing at once, so they can be fetched together
+                    continue;
                 }
                 QJsonParseError err;
                 const auto obj = QJsonDocument::fromJson(response, &err).object();
@@ -186,6 +193,9 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                                 std::move(componentObjects[key]))));
 
         }
+        if(!missing.isEmpty()) {
+            ERR(toStr("Component not found", missing.join(',')))
+        }
         return map;
     }
 
@@ -214,9 +224,14 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return p.getElement(obj);
     }
 
-     std::optional<FigmaParser::Element> FigmaParser::element(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const Components& components) {
+     std::optional<FigmaParser::Element> FigmaParser::element(const QJsonObject& obj, unsigned flags, FigmaParserData& data, const Components& components, const QString& elementName) {
         FigmaParser p(flags, data, &components);
-        return p.getElement(obj);
+        return p.getElement(obj, elementName);
+    }
+
+    // element names are made unique on creation, therefore resolve once and pass to element()
+    QString FigmaParser::elementName(const QJsonObject& obj) {
+        return validFileName(obj["name"].toString(), false);
     }
 
     QString FigmaParser::name(const QJsonObject& project) {
@@ -322,7 +337,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return cList;
     }
 
-    std::optional<FigmaParser::Element> FigmaParser::getElement(const QJsonObject& obj) {
+    std::optional<FigmaParser::Element> FigmaParser::getElement(const QJsonObject& obj, const QString& elementName) {
         m_parent.push(&obj);
         RAII_ raii {[this](){m_parent.pop();}};
         auto bytes = parse(obj, 1);
@@ -356,7 +371,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             aliases.append(alias.id);
 
         return Element{
-                validFileName(obj["name"].toString(), false),
+                elementName.isEmpty() ? validFileName(obj["name"].toString(), false) : elementName,
                 obj["id"].toString(),
                 obj["type"].toString(),
                 std::move(bytes.value()),
@@ -364,7 +379,8 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 std::move(image_contexts),
                 std::move(aliases),
                 m_componentStreams,
-                m_externalLoaders
+                m_externalLoaders,
+                std::move(m_nodes)
         };
     }
 
@@ -420,10 +436,13 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
                 .arg(static_cast<unsigned>(std::round(b * 255.)), 2, 16, QLatin1Char('0')).toLatin1();
     }
 
-     QByteArray FigmaParser::makeId(const QJsonObject& obj)  {
-        QString cid = obj["id"].toString();
+     QByteArray FigmaParser::qmlId(const QString& figmaId) {
         static const QRegularExpression re(R"([^a-zA-Z0-9])");
-        const auto qml_id = ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
+        return ID_PREFIX + QString(figmaId).replace(re, "_").toLower().toLatin1();
+     }
+
+     QByteArray FigmaParser::makeId(const QJsonObject& obj)  {
+        const auto qml_id = qmlId(obj["id"].toString());
         //if(qml_id == "figma_711_1213") {
         //    qDebug() << "what is here?";
         //}
@@ -511,9 +530,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
 
     QByteArray FigmaParser::makeId(const QString& prefix, const QJsonObject& obj)  {
-        QString cid = obj["id"].toString();
-        static const QRegularExpression re(R"([^a-zA-Z0-9])");
-        const auto qml_id = prefix.toLatin1() + ID_PREFIX + cid.replace(re, "_").toLower().toLatin1();
+        const auto qml_id = prefix.toLatin1() + qmlId(obj["id"].toString());
         m_parent.ids.insert(QString(qml_id));
         return qml_id;
     }
@@ -1023,6 +1040,7 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
 
     EByteArray FigmaParser::parse(const QJsonObject& obj, int indents) {
         const auto type = obj["type"].toString();
+        TRACE_SUM(type);
         const QHash<QString, std::function<EByteArray (const QJsonObject&, int)> > parsers {
             {"RECTANGLE", std::bind(&FigmaParser::parseVector, this, std::placeholders::_1, std::placeholders::_2)},
             {"TEXT", std::bind(&FigmaParser::parseText, this, std::placeholders::_1, std::placeholders::_2)},
@@ -1047,6 +1065,8 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
             ERR(QString("Non supported object type:\"%1\"").arg(type))
         }
 
+        addNode(obj);
+
         if(isRendering(obj)) {
             return parseContainer(obj, Content::Rendered, indents);
         }
@@ -1060,6 +1080,21 @@ std::optional<FigmaParser::Components> FigmaParser::components(const QJsonObject
         return parsers[type](obj, indents);
     }
 
+    // collected while parsing for the search, not to walk the document again
+    void FigmaParser::addNode(const QJsonObject& obj) {
+        const auto id = obj["id"].toString();
+        if(m_nodeIds.contains(id))
+            return;
+        m_nodeIds.insert(id);
+        QString component;
+        if(obj["type"] == "INSTANCE") {
+            const auto it = m_components->constFind(obj["componentId"].toString());
+            if(it != m_components->constEnd())
+                component = (*it)->name();
+        }
+        m_nodes.append({id, obj["name"].toString(), obj["characters"].toString(), component, imageFill(obj).value_or(QString())});
+    }
+
     bool FigmaParser::isGradient(const QJsonObject& obj) const {
          if(obj.contains("fills")) {
              const auto array = obj["fills"].toArray();
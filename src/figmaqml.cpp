@@ -5,6 +5,8 @@
 #include "fontinfo.h"
 #include "utils.h"
 #include "appwrite.h"
+#include "tracer.h"
+#include "memorystats.h"
 #include <QVersionNumber>
 #include <QTimer>
 #include <QSaveFile>
@@ -15,15 +17,15 @@
 #include <QFontInfo>
 #include <QStandardPaths>
 #include <QFileInfo>
+#include <QCryptographicHash>
 #ifdef USE_NATIVE_FONT_DIALOG
 #include <QFontDialog>
 #include <QApplication>
 #endif
 
 
-#include <QTime>
-#define TIMED_START(s)  const auto s = QTime::currentTime();
-#define TIMED_END(s, p) if(m_flags & Timed ) {emit info(toStr("timed", p, s.msecsTo(QTime::currentTime())));}
+#define TIMED_START(s)  const auto s = Tracer::now();
+#define TIMED_END(s, p) if(m_flags & Timed ) {Tracer::add("phase", p, s); emit info(toStr("timed", p, (Tracer::now() - s) / 1000));}
 
 #define SCAT(a, b) a ## b
 #define SCAT2(a, b) SCAT(a, b)
@@ -64,6 +66,44 @@ enum Format {
     None = 0, JPEG, PNG
 };
 
+const auto SuspendPoll = 500ms;
+const QByteArray PendingElement("Text{text: \"generating...\"}");
+const QByteArray FilteredElement("Text{text: \"filtered out\"}");
+
+// State of a single document generation, elements are generated one by one in the queue order
+class FigmaQml::Generation {
+public:
+    Generation(std::unique_ptr<FigmaDocument>&& doc, const QJsonObject& json, const std::optional<GenerationQueue::Index>& focus) :
+        document(std::move(doc)), target(document.get()), json(json), progressive(focus.has_value()),
+        queue(focus.value_or(GenerationQueue::Index{0, 0})), timer(new QTimer), started(Tracer::now()) {}
+    ~Generation() {
+        timer->stop();
+        timer->deleteLater(); // may be deleted within its own timeout
+    }
+    std::unique_ptr<FigmaDocument> document; // owned until published
+    FigmaDocument* target;
+    const QJsonObject json;
+    const bool progressive; // publish when the focused element is ready, otherwise when all are ready
+    std::optional<FigmaParser::Components> components;
+    std::optional<FigmaParser::Canvases> canvases;
+    QByteArray header;
+    std::vector<QStringList> names;
+    QSet<QString> generatedComponents;
+    GenerationQueue queue;
+    int generated = 0;
+    bool prepared = false;
+    bool published = false;
+    bool ok = true;         // a fatal error stops only this generation
+    bool cancelled = false;
+    bool suspended = false; // waits for the provider
+    QSet<QString> awaitedImages;      // what a suspended generation waits for
+    QSet<QString> awaitedRenderings;
+    QSet<QString> awaitedNodes;
+    std::function<void (FigmaDocument*)> publish = nullptr;
+    QTimer* timer;
+    const qint64 started;
+};
+
 FigmaQml::~FigmaQml() {
 }
 
@@ -111,6 +151,7 @@ bool FigmaQml::setCurrentElement(int current) {
         return false;
     if(current != currentElement()) {
         m_uiDoc->getCurrent()->setCurrent(current);
+        refocus();
         emit elementNameChanged();
         QTimer::singleShot(FrameDelay, this, [this](){emit currentElementChanged();}); //delayed
     }
@@ -125,6 +166,7 @@ bool FigmaQml::setCurrentCanvas(int current) {
         if(m_uiDoc->currentIndex() >= m_uiDoc->current().size()) {
             m_uiDoc->getCurrent()->setCurrent(m_uiDoc->current().size() - 1);
         }
+        refocus();
         emit currentCanvasChanged();
         emit elementNameChanged();
         emit elementCountChanged();
@@ -140,6 +182,8 @@ QString FigmaQml::validFileName(const QString& name) {
 }
 
 bool FigmaQml::saveAllQML(const QString& folderName) {
+    TRACE_SPAN("file", "saveAllQML");
+    MEMORY_STAGE("saveAllQML");
 #ifdef Q_OS_WINDOWS
     QDir d(folderName.startsWith('/') ? folderName.mid(1) : folderName);
 #else
@@ -148,6 +192,8 @@ bool FigmaQml::saveAllQML(const QString& folderName) {
     if(!ensureDirExists(d.absolutePath())) {
         return false;
     }
+    if(m_sourceGeneration)
+        emit warning("Document is still being generated, not all elements are saved");
     QSet<QString> componentNames;
     for(const auto& c : *m_sourceDoc) {
         for(const auto& e : *c) {
@@ -204,8 +250,15 @@ bool FigmaQml::saveAllQML(const QString& folderName) {
     return true;
 }
 
+// only the viewed elements are written into files
 QUrl FigmaQml::element() const {
-    return (m_uiDoc && !m_uiDoc->empty()) ?  QUrl::fromLocalFile(QString(m_uiDoc->current().data())) : QUrl();
+    if(!m_uiDoc || m_uiDoc->empty())
+        return QUrl();
+    if(!m_uiDoc->materialize()) {
+        emit error(toStr("Cannot write", m_uiDoc->current().data()));
+        return QUrl();
+    }
+    return QUrl::fromLocalFile(QString(m_uiDoc->current().data()));
 }
 
 QByteArray FigmaQml::sourceCode() const {
@@ -214,7 +267,7 @@ QByteArray FigmaQml::sourceCode() const {
 
 FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvider& provider, QObject *parent) : QObject(parent),
     m_qmlDir(qmlDir), mProvider(provider), m_imports(defaultImports()), m_fontCache(std::make_unique<FontCache>()), m_fontFolder(fontFolder),
-    m_fontInfo{ new FontInfo{this} } {
+    m_fontInfo{ new FontInfo{this} }, m_elements{ new ElementModel{this} } {
     qmlRegisterUncreatableType<FigmaQml>("FigmaQml", 1, 0, "FigmaQml", "");
     QObject::connect(this, &FigmaQml::currentElementChanged, this, [this]() {
         if(!m_uiDoc) {
@@ -265,8 +318,8 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
     };
 
     QObject::connect(this, QOverload<FigmaFileDocument*>::of(&FigmaQml::figmaDocumentCreated), this, [this](FigmaFileDocument* doc) {
-        Q_ASSERT(doc->type() == FigmaFileDocument::type());
-        Q_ASSERT(!m_uiDoc);
+        Q_ASSERT(!doc || doc->type() == FigmaFileDocument::type());
+        Q_ASSERT(!doc || !m_uiDoc);
         if(doc) {
             m_uiDoc.reset(doc);
             emit isValidChanged();
@@ -290,10 +343,11 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
     });
 
     QObject::connect(this, QOverload<FigmaDataDocument*>::of(&FigmaQml::figmaDocumentCreated), this, [this](FigmaDataDocument* doc) {
-        Q_ASSERT(doc->type() == FigmaDataDocument::type());
-        Q_ASSERT(!m_sourceDoc);
+        Q_ASSERT(!doc || doc->type() == FigmaDataDocument::type());
+        Q_ASSERT(!doc || !m_sourceDoc);
         if(doc) {
             m_sourceDoc.reset(doc);
+            m_elements->setDocument(doc, m_sourceGeneration ? m_sourceGeneration->queue.pending() : QSet<GenerationQueue::Index>{});
             emit sourceCodeChanged();
             emit documentCreated();
         } else {
@@ -302,18 +356,20 @@ FigmaQml::FigmaQml(const QString& qmlDir, const QString& fontFolder, FigmaProvid
     });
 
     QObject::connect(this, &FigmaQml::flagsChanged, this, &FigmaQml::updateDefaultImports);
+    QObject::connect(this, &FigmaQml::flagsChanged, this, [this]() {
+        Tracer::setEnabled(m_flags & Timed);
+    });
 
     QObject::connect(this, &FigmaQml::fontFolderChanged, this, fontFolderChanged);
     fontFolderChanged();
 
 
-    QObject::connect(this, &FigmaQml::canvasCountChanged, this, &FigmaQml::elementsChanged);
-    QObject::connect(this, &FigmaQml::elementCountChanged, this, &FigmaQml::elementsChanged);
-    QObject::connect(this, &FigmaQml::sourceCodeChanged, this, &FigmaQml::elementsChanged);
-
     // apply checkers pattern
     QObject::connect(this, &FigmaQml::currentElementChanged, this, &FigmaQml::applyExternalLoaders);
     QObject::connect(this, &FigmaQml::documentCreated, this, &FigmaQml::applyExternalLoaders);
+    QObject::connect(this, &FigmaQml::documentCompleted, this, &FigmaQml::applyExternalLoaders);
+
+    QObject::connect(this, &FigmaQml::cancelled, this, &FigmaQml::doCancel);
 
 }
 
@@ -349,26 +405,8 @@ void FigmaQml::updateDefaultImports() {
     }
 }
 
-QVariantList FigmaQml::elements() const {
-    QVariantList el_list;
-    int canvas_index = 0;
-    if(!m_sourceDoc)
-        return el_list;
-    for(const auto& canvas : *m_sourceDoc) {
-        int element_index = 0;
-        for(const auto& element : *canvas) {
-            QVariantMap map{
-                {"canvas", canvas_index},
-                {"element", element_index},
-                {"canvas_name", canvas->name()},
-                {"element_name", element->name()}
-            };
-            el_list.append(std::move(map));
-            ++element_index;
-        }
-        ++canvas_index;
-    }
-    return el_list;
+ElementModel* FigmaQml::elements() const {
+    return m_elements;
 }
 
 QVariantMap FigmaQml::defaultImports() const {
@@ -416,19 +454,7 @@ QStringList FigmaQml::components() const {
 QStringList FigmaQml::components(int canvas_index, int element_index) const {
     if(m_sourceDoc && !m_sourceDoc->empty()) {
         const auto key = (*(m_sourceDoc->begin() + canvas_index))->name(element_index);
-        const auto component_list = m_sourceDoc->components(key);
-        for(const auto& c : component_list) {
-            const auto name_s = qmlTargetDir() + '/' + c + ".qml";
-#if 0            // look for this solution, have element subcomponents in their own folders...
-            const auto name_l = qmlTargetDir() + '/' + c + ".qml";
-            Q_ASSERT(QFileInfo::exists(name_l) || QFileInfo::exists(name_s));
-#else
-            Q_ASSERT(QFileInfo::exists(name_s));
-#endif
-            Q_ASSERT(!m_sourceDoc->component(c).isEmpty());
-            Q_ASSERT(!m_sourceDoc->componentObject(c).isEmpty());
-        }
-        return component_list;
+        return m_sourceDoc->components(key);
     } else {
         return QStringList();
     }
@@ -448,7 +474,10 @@ void FigmaQml::cancel() {
 }
 
 void FigmaQml::doCancel() {
-    m_doCancel = true;
+    for(const auto& generation : {m_viewGeneration.get(), m_sourceGeneration.get()}) {
+        if(generation)
+            generation->cancelled = true;
+    }
 }
 
 void FigmaQml::setFilter(const QMap<int, QSet<int>>& filter) {
@@ -473,9 +502,11 @@ QByteArray FigmaQml::prettyData(const QByteArray& data) const {
 
 // folder is more of prefix...
 std::optional<QStringList> FigmaQml::saveImages(const QString &folder, const QSet<QString>& filter) const {
+    TRACE_SPAN("file", "saveImages");
     if(!ensureDirExists(folder))
         return std::nullopt;
     QStringList img_list;
+    QSet<QString> saved; // refs of identical content share a file
     for(const auto& [k, i] : m_imageFiles.asKeyValueRange()) {
         if(!filter.empty()) {
             if(m_imageContexts.contains(k)) {
@@ -495,6 +526,9 @@ std::optional<QStringList> FigmaQml::saveImages(const QString &folder, const QSe
             return std::nullopt;
         }
         const auto target = folder + file.fileName();
+        if(saved.contains(target))
+            continue;
+        saved.insert(target);
         img_list.append(target);
         const QFile targetEntry(target);
         if(targetEntry.exists(target)) {
@@ -536,6 +570,12 @@ bool FigmaQml::addImageFileData(const QString& imageRef, const QByteArray& bytes
         return false;
 
     const auto path = qmlTargetDir() + Images.mid(1);
+    // identical content is written once
+    const auto hash = QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+    if(const auto it = m_imageHashes.constFind(hash); it != m_imageHashes.constEnd()) {
+        m_imageFiles.insert(imageRef, {path, *it});
+        return true;
+    }
     int count = 1;
     static const QRegularExpression re(R"([\\\/:*?"<>|\s;])");
     auto name = imageRef;
@@ -560,6 +600,7 @@ bool FigmaQml::addImageFileData(const QString& imageRef, const QByteArray& bytes
         file.write(bytes);
         file.commit();
         m_imageFiles.insert(imageRef, {path, imageName});
+        m_imageHashes.insert(hash, imageName);
     }
     return true;
 }
@@ -590,37 +631,180 @@ void FigmaQml::setFonts(const QVariantMap& map) {
 }
 
 template<class FigmaDocType>
-void FigmaQml::createDocument(const QJsonObject& json) {
-    m_state = State::Suspend;
+void FigmaQml::createDocument(const QJsonObject& json, const std::optional<GenerationQueue::Index>& focus) {
+    auto& generation = std::is_same_v<FigmaDocType, FigmaFileDocument> ? m_viewGeneration : m_sourceGeneration;
     m_busy = true;
     emit busyChanged();
-    auto ctimer = new QTimer(this);
-    QObject::connect(ctimer, &QTimer::timeout, this, [ctimer, this, json](){
-        if(m_state == State::Suspend) {
-            if(mProvider.isReady()) {
-                m_state = State::Constructing;
-
-                auto doc = std::make_unique<FigmaDocType>(qmlTargetDir(), FigmaParser::name(json));
-                if(doCreateDocument(*doc, json)) {
-                    ctimer->stop();
-                    ctimer->deleteLater();
-                    Q_ASSERT(FigmaDocType::type() == doc->type());
-                    emit figmaDocumentCreated(doc.release());
-                } else if(m_state != State::Suspend) {
-                    parseError(FigmaParser::lastError(), true);
-                }
-                if(m_state != State::Suspend) {
-                    m_busy = false;
-                    emit busyChanged();
-                }
-            }
-        } else {
-            ctimer->stop();
-            ctimer->deleteLater();
-            emit figmaDocumentCreated(static_cast<FigmaDocType*>(nullptr));
-        }
+    generation = std::make_unique<Generation>(std::make_unique<FigmaDocType>(qmlTargetDir(), FigmaParser::name(json)), json, focus);
+    generation->publish = [this](FigmaDocument* doc) {
+        emit figmaDocumentCreated(static_cast<FigmaDocType*>(doc));
+    };
+    QObject::connect(generation->timer, &QTimer::timeout, this, [this, &generation]() {
+        generate(generation);
     });
-    ctimer->start(500);
+    generation->timer->start(SuspendPoll);
+}
+
+void FigmaQml::generate(std::unique_ptr<Generation>& generation) {
+    if(!generation)
+        return;
+    auto current = generation.get();
+    if(current->cancelled) {
+        endGeneration(generation);
+        return;
+    }
+    if(current->suspended && !isAwaited(*current))
+        return;
+    current->suspended = false;
+    m_generation = current;
+    const auto ok = current->prepared ? generateNext(*current) : prepareGeneration(*current);
+    if(current->suspended) {
+        m_generation = nullptr;
+        current->timer->setInterval(SuspendPoll); // wait until provider has fetched what was missing
+        return;
+    }
+    if(!ok) {
+        parseError(FigmaParser::lastError(), true);
+        m_generation = nullptr;
+        if(generation.get() == current)
+            endGeneration(generation);
+        return;
+    }
+    m_generation = nullptr;
+    current->timer->setInterval(0);
+
+    const auto completed = current->prepared && current->queue.isEmpty()
+            && current->generatedComponents.size() == current->components->size();
+
+    const auto viewable = current->progressive && current->prepared
+            && (current->generated > 0 || current->queue.isEmpty());
+
+    if(!current->published && (completed || viewable)) {
+        current->published = true;
+        m_busy = false;
+        emit busyChanged();
+        MEMORY_STAGE("publish");
+        current->publish(current->document.release());
+        if(generation.get() != current) // publish may have started a new generation
+            return;
+    }
+
+    if(completed) {
+        TIMED_END(current->started, "Generation")
+        const auto isSource = &generation == &m_sourceGeneration;
+        generation.reset();
+        if(isSource)
+            emit documentCompleted();
+    }
+}
+
+// only what the generation asked for is waited, not traffic of the other generation
+bool FigmaQml::isAwaited(Generation& generation) {
+    generation.awaitedImages.removeIf([this](const QString& id) {return mProvider.cachedImage(id).has_value();});
+    generation.awaitedRenderings.removeIf([this](const QString& id) {return mProvider.cachedRendering(id).has_value();});
+    generation.awaitedNodes.removeIf([this](const QString& id) {return mProvider.cachedNode(id).has_value();});
+    const auto arrived = generation.awaitedImages.isEmpty() && generation.awaitedRenderings.isEmpty() && generation.awaitedNodes.isEmpty();
+    // a failed fetch never arrives, the step is run again to tell it when nothing is on its way
+    if(!arrived && !mProvider.isReady())
+        return false;
+    generation.awaitedImages.clear();
+    generation.awaitedRenderings.clear();
+    generation.awaitedNodes.clear();
+    return true;
+}
+
+// failed or cancelled, the ones waiting for a document or its completion are still told
+void FigmaQml::endGeneration(std::unique_ptr<Generation>& generation) {
+    const auto isSource = &generation == &m_sourceGeneration;
+    const auto published = generation->published;
+    generation.reset();
+    if(!published) {
+        m_busy = false;
+        emit busyChanged();
+        if(isSource)
+            emit figmaDocumentCreated(static_cast<FigmaDataDocument*>(nullptr));
+        else
+            emit figmaDocumentCreated(static_cast<FigmaFileDocument*>(nullptr));
+    }
+    if(isSource)
+        emit documentCompleted();
+}
+
+bool FigmaQml::prepareGeneration(Generation& generation) {
+    Q_ASSERT(m_imageDimensionMax > 0);
+
+    if(!ensureDirExists(qmlTargetDir()))
+       return false;
+
+    TIMED_START(t1)
+
+    generation.components = FigmaParser::components(generation.json, *this);
+    if(!generation.components)
+        return false;
+
+    generation.canvases = FigmaParser::canvases(generation.json);
+    if(!generation.canvases)
+        return false;
+
+    generation.header = makeHeader();
+
+    // all elements are added as placeholders first, so the document is complete in shape when published
+    int canvas_index = 0;
+    for(const auto& c : *generation.canvases) {
+        auto canvas = generation.target->addCanvas(c.name());
+        QStringList names;
+        int element_index = 0;
+        for(const auto& f : c.elements()) {
+            const auto name = FigmaParser::elementName(f);
+            names.append(name);
+            const auto filtered = !m_filter.isEmpty()
+                    && (!m_filter.contains(canvas_index + 1)
+                        || (!m_filter[canvas_index + 1].isEmpty() && !m_filter[canvas_index + 1].contains(element_index + 1)));
+            if(!canvas->addElement(name, generation.header + (filtered ? FilteredElement : PendingElement)))
+                return false;
+            if(!filtered)
+                generation.queue.insert({canvas_index, element_index});
+            ++element_index;
+        }
+        generation.names.push_back(names);
+        ++canvas_index;
+    }
+    generation.prepared = true;
+
+    TIMED_END(t1, "Prepare")
+    return true;
+}
+
+bool FigmaQml::generateNext(Generation& generation) {
+    if(!generation.progressive) {
+        // as earlier, all components first
+        for(const auto& id : generation.components->keys()) {
+            if(!generateComponent(generation, id))
+                return false;
+        }
+    }
+
+    if(!generation.queue.isEmpty()) {
+        const auto index = generation.queue.next();
+        if(!generateElement(generation, index))
+            return false;
+        generation.queue.remove(index);
+        ++generation.generated;
+        if(&generation == m_sourceGeneration.get() && generation.published)
+            m_elements->setReady(index);
+        if(generation.published && index == GenerationQueue::Index{currentCanvas(), currentElement()}) {
+            emit sourceCodeChanged();
+            emit componentsChanged();
+        }
+        return true;
+    }
+
+    // rest of components that are not used by any element
+    for(const auto& id : generation.components->keys()) {
+        if(!generateComponent(generation, id))
+            return false;
+    }
+    return true;
 }
 
 QString FigmaQml::qmlTargetDir() const {
@@ -636,22 +820,24 @@ void FigmaQml::createDocumentView(const QByteArray &data, bool restoreView) {
     if(!json)
         return;
 
+    const auto restoredCanvas = restoreView ? currentCanvas() : 0;
+    const auto restoredElement = restoreView ? currentElement() : 0;
+
     reset(restoreView, true, true, true);
     m_embedImages = true;
 
-    const auto restoredCanvas = currentCanvas();
-    const auto restoredElement = currentElement();
-
-    mRestore = [this, restoreView, restoredElement, restoredCanvas, data](bool has_doc){
+    // the parsed object is shared, data may not outlive this call
+    mRestore = [this, restoreView, restoredElement, restoredCanvas, json = *json](bool has_doc){
         if(has_doc)
-             createDocumentSources(data);
+             createSources(json, GenerationQueue::Index{restoredCanvas, restoredElement});
         if(restoreView) {
             if(setCurrentCanvas(restoredCanvas))
                 setCurrentElement(restoredElement);
         }
     };
 
-    createDocument<FigmaFileDocument>(*json);
+    // view is published as soon as the element in focus is ready, rest follows in background
+    createDocument<FigmaFileDocument>(*json, GenerationQueue::Index{restoredCanvas, restoredElement});
 
     emit isValidChanged();
 }
@@ -672,19 +858,35 @@ void FigmaQml::resetFontMappings() {
 
 
 void FigmaQml::createDocumentSources(const QByteArray &data) {
-    const auto json = object(data);
-    if(!json)
-        return;
+    if(const auto json = object(data))
+        createSources(*json, std::nullopt);
+}
 
+void FigmaQml::createSources(const QJsonObject& json, const std::optional<GenerationQueue::Index>& focus) {
+    m_sourceGeneration.reset();
+    m_elements->setDocument(nullptr);
     m_sourceDoc.reset();
+    m_search.clear();
     m_embedImages = m_flags & EmbedImages;
 
-    createDocument<FigmaDataDocument>(*json);
+    createDocument<FigmaDataDocument>(json, focus);
+}
 
+void FigmaQml::stopGenerations() {
+    m_viewGeneration.reset();
+    m_sourceGeneration.reset();
+}
+
+void FigmaQml::refocus() {
+    const GenerationQueue::Index focus{currentCanvas(), currentElement()};
+    for(const auto& generation : {m_viewGeneration.get(), m_sourceGeneration.get()}) {
+        if(generation)
+            generation->queue.setFocus(focus);
+    }
 }
 
 void FigmaQml::restore(int flags, const QVariantMap& imports) {
-    m_flags = flags;
+    m_flags = flags | (m_flags & Timed); // timing is not a property of the stored document
     m_imports = imports;
 }
 
@@ -701,6 +903,8 @@ std::optional<QJsonObject> FigmaQml::object(const QByteArray &data) {
     if(data.isEmpty())
         return std::nullopt;
 
+    TRACE_SPAN("json", "parse");
+    MEMORY_STAGE("object");
     QJsonParseError parseError;
     const auto json = QJsonDocument::fromJson(data, &parseError);
     if(parseError.error != QJsonParseError::NoError) {
@@ -717,6 +921,14 @@ std::optional<QJsonObject> FigmaQml::object(const QByteArray &data) {
     return json.object();
 }
 
+bool FigmaQml::saveTrace(const QString& fileName) const {
+    if(!Tracer::write(fileName)) {
+        emit error(toStr("Cannot write trace", fileName));
+        return false;
+    }
+    return true;
+}
+
 bool FigmaQml::busy() const {
     return m_busy;
 }
@@ -756,15 +968,14 @@ void FigmaQml::setSignals(bool allow) {
 }
 
 void FigmaQml::parseError(const QString& str, bool isFatal) {
-    if(m_state != State::Suspend) {
-        if(!m_doCancel) {
-            if(isFatal) {
-                m_ok = false;
-                emit error(str);
-            } else
-                emit warning(str);
-        }
-    }
+    if(m_generation && (m_generation->suspended || m_generation->cancelled))
+        return;
+    if(isFatal) {
+        if(m_generation)
+            m_generation->ok = false;
+        emit error(str);
+    } else
+        emit warning(str);
 }
 
 std::optional<std::tuple<QByteArray, int>> FigmaQml::getImage(const QString& imageRef, bool isRendering) {
@@ -773,21 +984,26 @@ std::optional<std::tuple<QByteArray, int>> FigmaQml::getImage(const QString& ima
         if(imageData)
             return imageData;
         mProvider.getRendering(imageRef);
+        if(m_generation)
+            m_generation->awaitedRenderings.insert(imageRef);
     } else {
         const auto imageData = mProvider.cachedImage(imageRef);
         if(imageData)
             return imageData;
         mProvider.getImage(imageRef, QSize(m_imageDimensionMax, m_imageDimensionMax));
+        if(m_generation)
+            m_generation->awaitedImages.insert(imageRef);
     }
     return std::nullopt;
 }
 
 void FigmaQml::suspend() {
-    m_state = State::Suspend;
+    if(m_generation)
+        m_generation->suspended = true;
 }
 
 QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
-    if(!m_ok || m_doCancel)
+    if(m_generation && (!m_generation->ok || m_generation->cancelled))
         return QByteArray();
     if(imageRef == FigmaParser::PlaceHolder)
         return m_brokenPlaceholder;
@@ -803,6 +1019,7 @@ QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
                 return QByteArray();
             Q_ASSERT(mime == JPEG || mime == PNG);
             const QByteArray mimeString = mime == JPEG ? "jpeg" : "png";
+            TRACE_SPAN("image", "base64");
             return "data:image/" + mimeString + ";base64," + bytes.toBase64();
         } else {
             if(!m_imageFiles.contains(imageRef)) {
@@ -821,11 +1038,13 @@ QByteArray FigmaQml::imageData(const QString& imageRef, bool isRendering) {
 }
 
 QByteArray FigmaQml::nodeData(const QString& id) {
-    if(!m_ok || m_doCancel)
+    if(m_generation && (!m_generation->ok || m_generation->cancelled))
         return QByteArray();
     const auto node = mProvider.cachedNode(id);
     if(!node) {
         mProvider.getNode(id);
+        if(m_generation)
+            m_generation->awaitedNodes.insert(id);
         suspend();
         return {};
     }
@@ -837,6 +1056,7 @@ QString FigmaQml::fontInfo(const QString& requestedFont) {
         return requestedFont;
     if(m_fontCache->contains(requestedFont))
         return (*m_fontCache)[requestedFont];
+    TRACE_SPAN("font", requestedFont);
     const auto value = nearestFontFamily(requestedFont, m_flags & AltFontMatch);
     m_fontCache->insert(requestedFont, value);
     return value;
@@ -851,6 +1071,7 @@ bool FigmaQml::writeQmlFile(const QString& component_name, const QByteArray& ele
     const auto content = header + element_data;
     const auto filename = uniqueFilename(qname, content);
     if(filename) {
+        TRACE_SPAN("file", component_name);
         QDir().mkpath((QFileInfo(*filename).path()));
         QSaveFile componentFile(*filename);
         if(!componentFile.open(QIODevice::WriteOnly)) {
@@ -864,138 +1085,182 @@ bool FigmaQml::writeQmlFile(const QString& component_name, const QByteArray& ele
 }
 
 
-bool FigmaQml::writeComponents(FigmaDocument& doc, const FigmaParser::Components& components, const QByteArray& header) {
-    qDebug() << "write componets!";
-    for(const auto& c : components) {
-
-      const auto component_opt = FigmaParser::component(c->object(), m_flags, *this, components);
-      if(!m_ok || m_doCancel || !component_opt)
-          return false;
-      const auto& component = component_opt.value();
-      if(component.data().isEmpty()) {
-          emit error(toStr("Invalid component", component.name()));
-          return false;
-      }
+bool FigmaQml::generateComponent(Generation& generation, const QString& id) {
+    if(generation.generatedComponents.contains(id))
+        return true;
+    const auto& components = *generation.components;
+    Q_ASSERT(components.contains(id));
+    const auto& c = components[id];
+    TRACE_SPAN("component", c->name());
+    MEMORY_STAGE("generateComponent");
 
-      const auto images = component.imageContexts();
-      for(const auto& im : images) {
-          if(!m_imageContexts.contains(im))
-              m_imageContexts.insert(im, {});
-          m_imageContexts[im].insert(components[component.id()]->name());
-      }
-
-      doc.addComponent(components[component.id()]->name(),
-              components[component.id()]->object(), header + component.data());
+    const auto component_opt = FigmaParser::component(c->object(), m_flags, *this, components);
+    if(!generation.ok || generation.cancelled || !component_opt || generation.suspended)
+        return false;
+    const auto& component = component_opt.value();
+    if(component.data().isEmpty()) {
+        emit error(toStr("Invalid component", component.name()));
+        return false;
+    }
 
+    const auto images = component.imageContexts();
+    for(const auto& im : images) {
+        if(!m_imageContexts.contains(im))
+            m_imageContexts.insert(im, {});
+        m_imageContexts[im].insert(c->name());
+    }
 
-      QStringList componentNames;
-      for(const auto& id : component.components()) {
-          Q_ASSERT(components.contains(id)); //just check here
-          const auto compname = components[id]->name();
-          componentNames.append(compname);
-      }
+    generation.target->addComponent(c->name(), c->object(), generation.header + component.data());
+    if(&generation == m_sourceGeneration.get())
+        addSearchHits(c->name(), generation.header, {-1, -1}, component);
 
-      const auto subs = component.subComponents();
-      for(const auto& [sub_name, sub_data] : subs.asKeyValueRange()) {
-          const auto data = header + std::get<QByteArray>(sub_data);
-          doc.addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
-          //if(std::get<QString>(sub_data).isEmpty()) {
-              if(!writeQmlFile(sub_name, data, header/*, c->name()*/)) {
-                  emit error(toStr("Cannot write sub component", sub_name, " for ", component.name()));
-                  return false;
-              }
-          //}
-      }
+    const auto subs = component.subComponents();
+    for(const auto& [sub_name, sub_data] : subs.asKeyValueRange()) {
+        const auto data = generation.header + std::get<QByteArray>(sub_data);
+        generation.target->addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
+        if(!writeQmlFile(sub_name, data, generation.header)) {
+            emit error(toStr("Cannot write sub component", sub_name, " for ", component.name()));
+            return false;
+        }
+    }
 
-      m_externalLoaders.insert(component.externalLoaders());
+    m_externalLoaders.insert(component.externalLoaders());
 
+    if(!writeQmlFile(c->name(), component.data(), generation.header)) {
+        emit error(toStr("Cannot write component", component.name()));
+        return false;
+    }
 
-      if(!writeQmlFile(c->name(), component.data(), header)) {
-          emit error(toStr("Cannot write component", component.name()));
-          return false;
-      }
+    generation.generatedComponents.insert(id);
 
+    // components this component is composed of
+    for(const auto& sub_id : component.components()) {
+        Q_ASSERT(components.contains(sub_id));
+        if(!generateComponent(generation, sub_id)) {
+            generation.generatedComponents.remove(id); // retry all
+            return false;
+        }
     }
     return true;
 }
 
 
-bool FigmaQml::setDocument(FigmaDocument& doc,
-                           const FigmaParser::Canvases& canvases,
-                           const FigmaParser::Components& components,
-                           const QByteArray& header) {
-    int currentCanvas = 0;
+bool FigmaQml::generateElement(Generation& generation, const GenerationQueue::Index& index) {
+    const auto& [canvas_index, element_index] = index;
+    const auto& components = *generation.components;
+    const auto& name = generation.names[canvas_index][element_index];
+    const auto& obj = (*generation.canvases)[canvas_index].elements()[element_index];
+    TRACE_SPAN("element", name);
+    TRACE_TOTALS("node"); // per node type, not per node
+    MEMORY_STAGE("generateElement");
 
-    int currentElement = 0;
+    const auto element_opt = FigmaParser::element(obj, m_flags, *this, components, name);
+    if(!element_opt)
+        return false;
+    const auto& element = element_opt.value();
 
-    for(const auto& c : canvases) {
-        ++currentCanvas;
-        currentElement = 0;
-        auto canvas = doc.addCanvas(c.name());
+    const auto images = element.imageContexts();
+    for(const auto& im : images) {
+        if(!m_imageContexts.contains(im))
+            m_imageContexts.insert(im, {});
+        m_imageContexts[im].insert(name);
+    }
 
-        const auto elements = c.elements();
+    if(generation.suspended || generation.cancelled || !generation.ok)
+        return false;
 
-        qDebug() << "write elements";
+    // components needed are generated before the element itself
+    QStringList componentNames;
+    for(const auto& id : element.components()) {
+        if(!generateComponent(generation, id))
+            return false;
+        componentNames.append(components[id]->name());
+    }
 
-        for(const auto& f : elements) {
-            if(m_state == State::Suspend)
-                return false;
-            if(m_doCancel)
-                return false;
-            bool hasElement = true;
-            if(!m_filter.isEmpty()) {
-                ++currentElement;
-                const auto keys = m_filter.keys();
-                if(!keys.contains(currentCanvas) || !m_filter[currentCanvas].contains(currentElement))
-                    hasElement = false;
-            }
+    m_externalLoaders.insert(element.externalLoaders());
 
-            const auto element_opt = hasElement ? FigmaParser::element(f, m_flags, *this, components) : FigmaParser::Element();
-            if(!element_opt)
-                return false;
-            const auto& element = element_opt.value();
+    // this is bit confusing, the component owned sub componets are written with the components,
+    // but as element owned has to be called elsewhere it happens here.
+    for(const auto& [sub_name, sub_data] : element.subComponents().asKeyValueRange()) {
+        componentNames.append(sub_name);
+        const auto data = generation.header + std::get<QByteArray>(sub_data);
+        generation.target->addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
+        if(!writeQmlFile(sub_name, data, generation.header))
+            return false;
+    }
+    generation.target->setComponents(name, std::move(componentNames));
 
-            const auto images = element.imageContexts();
-            for(const auto& im : images) {
-                if(!m_imageContexts.contains(im))
-                    m_imageContexts.insert(im, {});
-                m_imageContexts[im].insert(element.name());
-            }
-            if(m_state == State::Suspend)
-                return false;
+    if(&generation == m_sourceGeneration.get())
+        addSearchHits(name, generation.header, index, element);
 
-            if(m_doCancel)
-                return false;
-            if(!m_ok) {
-                return false;
-            }
-            if(!element.data().isEmpty())
-                canvas->addElement(element.name(), header + element.data());
-            else
-                canvas->addElement(element.name(), header + "Text{text: \"filtered out\"}");
-            QStringList componentNames;
-            for(const auto& id : element.components()) {
-                componentNames.append(components[id]->name());
-            }
+    auto canvas = (generation.target->begin() + canvas_index)->get();
+    return canvas->setElement(element_index, generation.header + (element.data().isEmpty() ? FilteredElement : element.data()));
+}
 
-            m_externalLoaders.insert(element.externalLoaders());
-
-            // this is bit confusing, the component owned sub componets are written before this function is called,
-            // but as element owned has to be called elsewhere it happens here. Whole this when is written and parsed
-            // what is confusing
-            for(const auto& [sub_name, sub_data] : element.subComponents().asKeyValueRange()) {
-                componentNames.append(sub_name);
-                const auto data = header + std::get<QByteArray>(sub_data);
-                doc.addComponent(sub_name, std::get<QJsonObject>(sub_data), data);
-                //if(std::get<QString>(sub_data).isEmpty()) {
-                    if(!writeQmlFile(sub_name, data, header/*, element.name()*/))
-                        return false;
-                //}
+// nodes are located by their QML id in the generated code, sub components have files of their own
+void FigmaQml::addSearchHits(const QString& name, const QByteArray& header, const GenerationQueue::Index& index, const FigmaParser::Element& parsed) {
+    TRACE_SPAN("search", name);
+    QStringList files{name + ".qml"};
+    QList<QByteArray> contents{parsed.data()};
+    for(const auto& [sub_name, sub_data] : parsed.subComponents().asKeyValueRange()) {
+        files.append(sub_name + ".qml");
+        contents.append(std::get<QByteArray>(sub_data));
+    }
+    const auto firstLine = static_cast<int>(header.count('\n')) + 1;
+    QHash<QByteArray, QPair<int, int>> locations; // QML id -> file, line
+    for(int file = 0; file < contents.size(); ++file) {
+        const auto& content = contents[file];
+        int line = firstLine;
+        for(qsizetype begin = 0; begin < content.size(); ++line) {
+            auto end = content.indexOf('\n', begin);
+            if(end < 0)
+                end = content.size();
+            auto pos = begin;
+            while(pos < end && content[pos] == ' ')
+                ++pos;
+            if(end - pos > 4 && qstrncmp(content.constData() + pos, "id: ", 4) == 0) {
+                const auto qmlId = content.mid(pos + 4, end - pos - 4).trimmed();
+                if(!locations.contains(qmlId))
+                    locations.insert(qmlId, {file, line});
             }
-            doc.setComponents(element.name(), std::move(componentNames));
+            begin = end + 1;
         }
     }
-    return true;
+
+    const auto canvas = index.first;
+    const auto element = index.second;
+    QVector<SearchIndex::Hit> hits;
+    if(canvas < 0)
+        hits.append({SearchIndex::Kind::Component, name, parsed.id(), canvas, element, files[0], firstLine});
+    for(const auto& node : parsed.nodes()) {
+        const auto location = locations.value(FigmaParser::qmlId(node.id), {0, 0});
+        const auto add = [&](SearchIndex::Kind kind, const QString& text) {
+            if(!text.isEmpty())
+                hits.append({kind, text, node.id, canvas, element, files[location.first], location.second});
+        };
+        add(SearchIndex::Kind::Name, node.name);
+        add(SearchIndex::Kind::Id, node.id);
+        add(SearchIndex::Kind::Text, node.characters);
+        add(SearchIndex::Kind::Instance, node.component);
+        add(SearchIndex::Kind::Image, node.imageRef);
+    }
+    m_search.insert(files[0], hits);
+}
+
+QVariantList FigmaQml::find(const QString& text, int max) const {
+    QVariantList list;
+    const auto hits = m_search.find(text, max);
+    for(const auto& hit : hits) {
+        list.append(QVariantMap{
+                        {"kind", SearchIndex::kindName(hit.kind)},
+                        {"text", hit.text},
+                        {"id", hit.nodeId},
+                        {"canvas", hit.canvas},
+                        {"element", hit.element},
+                        {"file", hit.file},
+                        {"line", hit.line}});
+    }
+    return list;
 }
 
 QByteArray FigmaQml::makeHeader() const {
@@ -1031,72 +1296,6 @@ QByteArray FigmaQml::makeHeader() const {
     return header;
 }
 
-bool FigmaQml::doCreateDocument(FigmaDocument& doc, const QJsonObject& json) {
-    m_ok = true;
-    m_doCancel = false; // uff UniqueConnection requires a member func
-    const auto d = QObject::connect(this, &FigmaQml::cancelled, this,
-                                    &FigmaQml::doCancel, Qt::UniqueConnection);
-
-    RAII(([d](){QObject::disconnect(d);}));
-
-
-    Q_ASSERT(m_imageDimensionMax > 0);
-
-    // erase 1st
-    QDir dir(qmlTargetDir());
-    const auto entries = dir.entryList();
-    if(!ensureDirExists(qmlTargetDir()))
-       return false;
-
-
-
-    const auto components = FigmaParser::components(json, *this);
-
-    if(!components) {
-        return false;
-    }
-
-     TIMED_START(t3)
-
-    /*
-    const auto keys = components->keys();
-    for (const auto k : keys) {
-        qDebug().nospace()
-                << k << ';'
-                << (*components)[k]->id() << ';'
-                << (*components)[k]->key() << ';'
-                << (*components)[k]->name();
-    }
-
-
-    static int loopers = 0;
-    ++loopers;
-    const auto [i, r, n] = mProvider.cacheInfo();
-    qDebug() << "loopers" << loopers << i << r << n;
-    */
-
-     const auto header = makeHeader();
-
-    if(!writeComponents(doc, *components, header)) {
-        return false;
-    }
-
-    TIMED_END(t3, "Component")
-    TIMED_START(t4)
-
-
-    const auto canvases = FigmaParser::canvases(json);
-    if(!canvases)
-        return false;
-
-    if(!setDocument(doc, *canvases, *components, header)) {
-        return false;
-    }
-
-    TIMED_END(t4, "elements")
-    return true;
-}
-
 #ifdef USE_NATIVE_FONT_DIALOG
 void FigmaQml::showFontDialog(const QString& currentFont) {
     auto w = QApplication::activeWindow();
@@ -1227,12 +1426,16 @@ unsigned FigmaQml::unique_number() {
 }
 
 Q_INVOKABLE void FigmaQml::reset(bool keepFonts, bool keepSources, bool keepImages, bool keepFetch) {
+    stopGenerations();
     cleanDir(m_qmlDir);
     m_imageFiles.clear();
+    m_imageHashes.clear();
     m_externalLoaders.clear();
     m_uiDoc.reset();
     if(!keepSources) {
+        m_elements->setDocument(nullptr);
         m_sourceDoc.reset();
+        m_search.clear();
         m_externalLoaders.clear();
     }
     if(!keepFonts)
@@ -1240,6 +1443,7 @@ Q_INVOKABLE void FigmaQml::reset(bool keepFonts, bool keepSources, bool keepImag
 
     if(!keepImages) {
         m_imageFiles.clear();
+        m_imageHashes.clear();
         m_crcs.clear();
         m_imageContexts.clear();
     }
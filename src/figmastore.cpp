@@ -0,0 +1,345 @@
+#include "figmastore.h"
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QSet>
+
+constexpr char Magic[] = "FQ05";
+constexpr qint64 MagicSize = 4;
+constexpr qint64 TrailerSize = sizeof(quint64) + MagicSize;
+constexpr quint32 IndexVersion = 1;
+
+// QDataStream files written before this format
+const QLatin1String LegacyStreamId("FQ04");
+const QLatin1String LegacyStreamIdV3("FQ03"); // had a checksum in place of the version
+
+// also the content address of a payload
+QByteArray FigmaStore::checksum(const QByteArray& bytes) {
+    return QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+}
+
+bool FigmaStore::isStore(const QString& filename) {
+    QFile file(filename);
+    return file.open(QIODevice::ReadOnly) && file.read(MagicSize) == QByteArray(Magic, MagicSize);
+}
+
+// the header of a FQ03 or FQ04 file, images, renderings and nodes follow it as FigmaData streams
+std::optional<FigmaStore::Meta> FigmaStore::readLegacy(QDataStream& stream, QByteArray& document) {
+    QString streamid;
+    stream >> streamid;
+    if(streamid != LegacyStreamId && streamid != LegacyStreamIdV3)
+        return std::nullopt;
+    Meta meta;
+    stream >> meta.projectToken;
+    stream >> document;
+    if(streamid == LegacyStreamIdV3) {
+        unsigned checksum;
+        stream >> checksum; // version is unknown, next update will fetch the document
+    } else {
+        stream >> meta.version;
+    }
+    stream >> meta.flags;
+    stream >> meta.imports;
+    return meta;
+}
+
+bool FigmaStore::open(const QString& filename) {
+    QMutexLocker lock(&m_mutex);
+    return openLocked(filename);
+}
+
+bool FigmaStore::openLocked(const QString& filename) {
+    closeLocked();
+    m_file.setFileName(filename);
+    if(!m_file.open(QIODevice::ReadOnly)) {
+        m_errorString = m_file.errorString() + " " + filename;
+        return false;
+    }
+    const auto fail = [this](const QString& reason) {
+        m_errorString = reason + " " + m_file.fileName();
+        closeLocked();
+        return false;
+    };
+    const auto size = m_file.size();
+    if(size < MagicSize + TrailerSize || m_file.read(MagicSize) != QByteArray(Magic, MagicSize))
+        return fail("Not a store");
+    m_file.seek(size - TrailerSize);
+    QDataStream trailer(&m_file);
+    quint64 indexOffset;
+    trailer >> indexOffset;
+    if(m_file.read(MagicSize) != QByteArray(Magic, MagicSize)
+            || indexOffset < static_cast<quint64>(MagicSize) || indexOffset > static_cast<quint64>(size - TrailerSize))
+        return fail("Store trailer corrupted");
+    m_file.seek(static_cast<qint64>(indexOffset));
+    const auto index = qUncompress(m_file.read(size - TrailerSize - static_cast<qint64>(indexOffset)));
+    if(index.isEmpty())
+        return fail("Store index corrupted");
+
+    QDataStream stream(index);
+    stream.setVersion(QDataStream::Qt_6_0);
+    quint32 version;
+    stream >> version;
+    if(version != IndexVersion)
+        return fail("Unsupported store version");
+    stream >> m_meta.projectToken >> m_meta.version >> m_meta.flags >> m_meta.imports;
+    for(auto& section : m_index) {
+        quint32 count;
+        stream >> count;
+        for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            QString id;
+            Entry e;
+            stream >> id >> e.url >> e.format >> e.offset >> e.storedSize >> e.size >> e.compressed >> e.checksum;
+            if(e.offset < MagicSize || e.storedSize < 0 || e.offset + e.storedSize > static_cast<qint64>(indexOffset))
+                return fail("Store index corrupted");
+            section.insert(id, e);
+        }
+    }
+    if(stream.status() != QDataStream::Ok)
+        return fail("Store index corrupted");
+    m_indexOffset = static_cast<qint64>(indexOffset);
+    return true;
+}
+
+void FigmaStore::close() {
+    QMutexLocker lock(&m_mutex);
+    closeLocked();
+}
+
+void FigmaStore::closeLocked() {
+    m_file.close();
+    m_meta = {};
+    m_indexOffset = 0;
+    for(auto& section : m_index)
+        section.clear();
+}
+
+bool FigmaStore::isOpen() const {
+    QMutexLocker lock(&m_mutex);
+    return m_file.isOpen();
+}
+
+QString FigmaStore::fileName() const {
+    QMutexLocker lock(&m_mutex);
+    return m_file.fileName();
+}
+
+QString FigmaStore::errorString() const {
+    QMutexLocker lock(&m_mutex);
+    return m_errorString;
+}
+
+FigmaStore::Meta FigmaStore::meta() const {
+    QMutexLocker lock(&m_mutex);
+    return m_meta;
+}
+
+QStringList FigmaStore::ids(Section section) const {
+    QMutexLocker lock(&m_mutex);
+    return m_index[section].keys();
+}
+
+std::optional<FigmaStore::Entry> FigmaStore::entry(Section section, const QString& id) const {
+    QMutexLocker lock(&m_mutex);
+    return entryLocked(section, id);
+}
+
+std::optional<FigmaStore::Entry> FigmaStore::entryLocked(Section section, const QString& id) const {
+    const auto it = m_index[section].constFind(id);
+    if(it == m_index[section].constEnd())
+        return std::nullopt;
+    return *it;
+}
+
+// bytes as stored, no decompression
+bool FigmaStore::readStored(const Entry& entry, QByteArray& bytes) const {
+    QMutexLocker lock(&m_mutex);
+    return readStoredLocked(entry, bytes);
+}
+
+bool FigmaStore::readStoredLocked(const Entry& entry, QByteArray& bytes) const {
+    if(!m_file.isOpen() || !m_file.seek(entry.offset)) {
+        m_errorString = "Store not readable " + m_file.fileName();
+        return false;
+    }
+    bytes = m_file.read(entry.storedSize);
+    if(bytes.size() != entry.storedSize) {
+        m_errorString = "Store truncated " + m_file.fileName();
+        return false;
+    }
+    return true;
+}
+
+// the entry and its bytes are read from the same file, even if it is updated meanwhile
+std::optional<QByteArray> FigmaStore::load(Section section, const QString& id) const {
+    QMutexLocker lock(&m_mutex);
+    const auto e = entryLocked(section, id);
+    if(!e)
+        return std::nullopt;
+    QByteArray stored;
+    if(!readStoredLocked(*e, stored))
+        return std::nullopt;
+    lock.unlock(); // decompressed and verified concurrently
+    auto bytes = e->compressed ? qUncompress(stored) : stored;
+    if(bytes.size() != e->size || checksum(bytes) != e->checksum) {
+        lock.relock();
+        m_errorString = QString("Checksum mismatch \"%1\" %2").arg(id, m_file.fileName());
+        return std::nullopt;
+    }
+    return bytes;
+}
+
+// bytes of entries and indices no more in the index
+qint64 FigmaStore::superseded() const {
+    QMutexLocker lock(&m_mutex);
+    QSet<qint64> offsets;
+    qint64 live = 0;
+    for(const auto& section : m_index) {
+        for(const auto& e : section) {
+            if(!offsets.contains(e.offset)) {
+                offsets.insert(e.offset);
+                live += e.storedSize;
+            }
+        }
+    }
+    return m_indexOffset - MagicSize - live;
+}
+
+// the file is closed while written, loads from other threads wait until it is read again
+bool FigmaStore::update(const std::function<bool ()>& write) {
+    QMutexLocker lock(&m_mutex);
+    const auto filename = m_file.fileName();
+    closeLocked(); // not to be open while replaced
+    const auto written = write();
+    const auto opened = openLocked(filename);
+    return written && opened;
+}
+
+// rewrites the store without superseded data, stays open
+bool FigmaStore::compact() {
+    const auto filename = fileName();
+    Writer writer(filename);
+    for(int section = 0; section < SectionCount; ++section) {
+        const auto sectionIds = ids(static_cast<Section>(section));
+        for(const auto& id : sectionIds) {
+            if(!writer.copy(static_cast<Section>(section), id, *this)) {
+                QMutexLocker lock(&m_mutex);
+                m_errorString = "Compact failed " + writer.errorString();
+                return false;
+            }
+        }
+    }
+    const auto storeMeta = meta();
+    bool committed = false;
+    const auto updated = update([&writer, &storeMeta, &committed]() {
+        committed = writer.commit(storeMeta);
+        return committed;
+    });
+    if(!committed) {
+        QMutexLocker lock(&m_mutex);
+        m_errorString = "Compact failed " + writer.errorString();
+    }
+    return updated;
+}
+
+FigmaStore::Writer::Writer(const QString& filename, Mode mode) : m_saveFile(filename), m_appendFile(filename), m_file(&m_saveFile) {
+    if(mode == Mode::Append) {
+        FigmaStore base;
+        if(base.open(filename) && m_appendFile.open(QIODevice::ReadWrite)) {
+            for(const auto& section : base.m_index)
+                for(const auto& e : section)
+                    m_blobs.insert(e.checksum, e);
+            m_appendFrom = m_appendFile.size();
+            m_appendFile.seek(m_appendFrom);
+            m_file = &m_appendFile;
+            return;
+        }
+        // not a store, written as a new one
+    }
+    if(m_saveFile.open(QIODevice::WriteOnly))
+        m_saveFile.write(Magic, MagicSize);
+}
+
+// an append not committed would leave the file without a trailer
+FigmaStore::Writer::~Writer() {
+    if(m_appendFile.isOpen())
+        m_appendFile.resize(m_appendFrom);
+}
+
+QString FigmaStore::Writer::errorString() const {
+    return m_file->errorString() + " " + m_file->fileName();
+}
+
+bool FigmaStore::Writer::append(Section section, const QString& id, const Entry& entry, const QByteArray& stored) {
+    if(!m_file->isOpen())
+        return false;
+    Entry e = entry;
+    e.offset = m_file->pos();
+    e.storedSize = stored.size();
+    if(m_file->write(stored) != stored.size())
+        return false;
+    m_index[section].insert(id, e);
+    m_blobs.insert(e.checksum, e);
+    return true;
+}
+
+// bytes already written, in this or in the appended file, are referred
+bool FigmaStore::Writer::reuse(Section section, const QString& id, const QByteArray& sum, const QString& url, int format) {
+    const auto blob = m_blobs.constFind(sum);
+    if(blob == m_blobs.constEnd())
+        return false;
+    auto e = *blob;
+    e.url = url;
+    e.format = format;
+    m_index[section].insert(id, e);
+    return true;
+}
+
+// JSON compresses well, images are compressed already
+bool FigmaStore::Writer::add(Section section, const QString& id, const QString& url, int format, const QByteArray& bytes) {
+    const auto sum = checksum(bytes);
+    if(reuse(section, id, sum, url, format))
+        return true;
+    const bool compressed = format == 0;
+    return append(section, id, {url, format, 0, 0, bytes.size(), compressed, sum},
+                  compressed ? qCompress(bytes) : bytes);
+}
+
+// an entry not loaded from a store is copied as it is
+bool FigmaStore::Writer::copy(Section section, const QString& id, const FigmaStore& from) {
+    const auto e = from.entry(section, id);
+    if(!e)
+        return false;
+    if(reuse(section, id, e->checksum, e->url, e->format))
+        return true;
+    QByteArray stored;
+    if(!from.readStored(*e, stored))
+        return false;
+    return append(section, id, *e, stored);
+}
+
+bool FigmaStore::Writer::commit(const Meta& meta) {
+    if(!m_file->isOpen())
+        return false;
+    QByteArray index;
+    QDataStream stream(&index, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << IndexVersion << meta.projectToken << meta.version << meta.flags << meta.imports;
+    for(const auto& section : m_index) {
+        stream << static_cast<quint32>(section.size());
+        for(auto it = section.constBegin(); it != section.constEnd(); ++it) {
+            const auto& e = it.value();
+            stream << it.key() << e.url << e.format << e.offset << e.storedSize << e.size << e.compressed << e.checksum;
+        }
+    }
+    const quint64 indexOffset = m_file->pos();
+    m_file->write(qCompress(index));
+    QDataStream trailer(m_file);
+    trailer << indexOffset;
+    m_file->write(Magic, MagicSize);
+    if(m_file == &m_saveFile)
+        return trailer.status() == QDataStream::Ok && m_saveFile.commit();
+    const auto appended = trailer.status() == QDataStream::Ok && m_appendFile.flush();
+    if(!appended)
+        m_appendFile.resize(m_appendFrom); // rolled back before the store is read again
+    m_appendFile.close();
+    return appended;
+}
@@ -1,9 +1,13 @@
 #include "figmaget.h"
+#include "figmalocal.h"
+#include "figmastore.h"
 #include "figmaqml.h"
 #include "clipboard.h"
 #include "downloads.h"
 #include "functorslot.h"
 #include "utils.h"
+#include "tracer.h"
+#include "memorystats.h"
 #include <QApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
@@ -12,6 +16,7 @@
 #include <QSurfaceFormat>
 #include <QSettings>
 #include <QTemporaryDir>
+#include <QFileInfo>
 #include <QCommandLineParser>
 #include <QTextStream>
 #include <QRegularExpression>
@@ -34,6 +39,8 @@ constexpr char EMBED_IMAGES[]{"embed_images"};
 constexpr char IMAGEMAXSIZE[]{"image_max_size"};
 constexpr char FONTFOLDER[]{"font_folder"};
 constexpr char THROTTLE[]{"throttle"};
+constexpr char MEMORY_BUDGET[]{"memory_budget"};
+constexpr char ASSET_CACHE[]{"asset_cache"};
 constexpr char FONTMAP[]{"font_map"};
 constexpr char IMPORTS[]{"imports"};
 constexpr char COMPANY_NAME[]{"Moonshine shade of haste productions"};
@@ -106,19 +113,31 @@ int main(int argc, char *argv[]) {
     const QCommandLineOption antialiasingShapesParameter("antialiasing-shapes", "Add antialiasing property to shapes.");
     const QCommandLineOption importsParameter("imports", "QML imports, ';' separated list of imported modules as <module-name> <version-number>.", "imports");
     const QCommandLineOption snapParameter("snap", "Take snapshot and exit, expects restore or user project token parameters to be given.", "snapFile");
-    const QCommandLineOption storeParameter("store", "Create .figmaqml file and exit, expects user and project token parameters to be given.");
-    const QCommandLineOption timedParameter("timed", "Time parsing process.");
+    const QCommandLineOption storeParameter("store", "Create .figmaqml file and exit, expects user and project token parameters to be given. An existing file of the same project is updated by appending changes.");
+    const QCommandLineOption compactParameter("compact", "Rewrite the restored .figmaqml file without data superseded by updates and exit.");
+    const QCommandLineOption timedParameter("timed", "Time parsing process, if a file name is given as --timed=<traceFile> or --timed <traceFile>.json, a Chrome trace (chrome://tracing) is written there.", "traceFile");
+    const QCommandLineOption memoryStatsParameter("memory-stats", "Report allocations and peak memory per conversion stage.");
     const QCommandLineOption figmaFontParameter("keepFigmaFont", "Do not resolve fonts, keep original font names.");
     const QCommandLineOption showFontsParameter("show-fonts", "Show the font mapping.");
     const QCommandLineOption fontFolderParameter("font-folder", "Add an additional path to search fonts.", "fontFolder");
     const QCommandLineOption showParameter("show", "Set current page and view to <page index>-<view index>, indexing starts from 1.", "show");
+    const QCommandLineOption scopeParameter("scope", "Fetch and generate only the given pages and views, ';' separated list of <page index>[-<view index>], indexing starts from 1. Implied by '--show' when taking a snapshot.", "scope");
     const QCommandLineOption altFontMatchParameter("alt-font-match", "Use alternative font matching algorithm.");
     const QCommandLineOption fontMapParameter("font-map", "Provide a ';' separated list of <figma font>':'<system font> pairs.", "fontMap");
-    const QCommandLineOption throttleParameter("throttle", "Milliseconds between server requests. Too frequent request may have issues, especially with big desings - default 300", "throttle");
+    const QCommandLineOption throttleParameter("throttle", "Average milliseconds between server requests. Too frequent request may have issues, especially with big desings - default 300", "throttle");
+    const QCommandLineOption memoryBudgetParameter("memory-budget", "Megabytes of images and renderings kept in memory, the least recently used are spilled to disk, 0 is no limit - default 512", "memoryBudget");
+    const QCommandLineOption assetCacheParameter("asset-cache", "Megabytes of images and renderings cached on disk and shared by all projects and runs, 0 disables - default 1024", "assetCache");
+    const QCommandLineOption concurrencyParameter("concurrency", "Maximum number of concurrent server requests - default 6", "concurrency");
+    const QCommandLineOption apiUrlParameter("api-url", "Figma REST API URL, e.g. a local server for testing - default https://api.figma.com/v1/", "apiUrl");
+    const QCommandLineOption recordParameter("record", "Record all server responses with their timing into a directory.", "dir");
+    const QCommandLineOption replayParameter("replay", "Answer server requests from a directory recorded with '--record' instead of network.", "dir");
+    const QCommandLineOption offlineParameter("offline", "Serve the restored .figmaqml file without network, implied if a capture or a --record directory is given in place of the file.");
+    const QCommandLineOption latencyParameter("latency", "Milliseconds to answer each request when offline, for repeatable benchmarks - default 0", "latency");
     const QCommandLineOption qulmodeParameter("qul-mode", "QtQuick for Qt for MCU");
+    const QCommandLineOption findParameter("find", "Print where nodes of the given name, id, text, component or image reference are generated to and exit. Expects restore or user and project token parameters to be given.", "text");
     const QCommandLineOption staticCodeParameter("static-code", "Do not generate any dynamic, interactive code, property access, event handlers etc.");
 
-    parser.addPositionalArgument("argument 1", "Optional: .figmaqml file or user token. GUI opened if empty.", "<FIGMAQML_FILE>|<USER_TOKEN>");
+    parser.addPositionalArgument("argument 1", "Optional: .figmaqml file, capture directory or user token. GUI opened if empty.", "<FIGMAQML_FILE>|<USER_TOKEN>");
     parser.addPositionalArgument("argument 2", "Optional: Output directory name (or .figmaqml file name if '--store' is given), assuming the first parameter was the restored file. If empty, GUI is opened. Project token is expected if the first parameter was an user token.", "<OUTPUT if FIGMAQML_FILE>| PROJECT_TOKEN if USER_TOKEN");
     parser.addPositionalArgument("argument 3", "Optional: Output directory name (or .figmaqml file name if '--store' is given), assuming the user and project tokens were provided. ", "<OUTPUT if USER_TOKEN>");
 
@@ -131,21 +150,43 @@ int main(int argc, char *argv[]) {
                           importsParameter,
                           snapParameter,
                           storeParameter,
+                          compactParameter,
                           timedParameter,
+                          memoryStatsParameter,
                           showParameter,
+                          scopeParameter,
                           showFontsParameter,
                           fontFolderParameter,
                           altFontMatchParameter,
                           fontMapParameter,
                           throttleParameter,
+                          concurrencyParameter,
+                          memoryBudgetParameter,
+                          assetCacheParameter,
+                          apiUrlParameter,
+                          recordParameter,
+                          replayParameter,
+                          offlineParameter,
+                          latencyParameter,
                           figmaFontParameter,
                           staticCodeParameter,
+                          findParameter,
 #ifdef HAS_QUL
                           qulmodeParameter,
 #endif
                       });
 
-    parser.process(app);
+    // --timed can be given without a value, a following .json is taken as its trace file
+    auto arguments = app.arguments();
+    for(auto i = 1; i < arguments.size(); ++i) {
+        if(arguments[i] != "--timed" && arguments[i] != "-timed")
+            continue;
+        if(i + 1 < arguments.size() && !arguments[i + 1].startsWith('-') && arguments[i + 1].endsWith(".json", Qt::CaseInsensitive))
+            arguments[i] = "--timed=" + arguments.takeAt(i + 1);
+        else
+            arguments[i] = "--timed=";
+    }
+    parser.process(arguments);
 
     int state = 0;
 
@@ -177,13 +218,26 @@ int main(int argc, char *argv[]) {
         parser.showHelp(-10);
     }
 
+    if(parser.isSet(compactParameter)) {
+        if(restore.isEmpty() || !FigmaStore::isStore(restore))
+            parser.showHelp(-17);
+        FigmaStore store;
+        const auto size = QFileInfo(restore).size();
+        if(!store.open(restore) || !store.compact()) {
+            ::print() << "Error: " << store.errorString() << Qt::endl;
+            return -1;
+        }
+        ::print() << "Compacted " << restore << " from " << size << " to " << QFileInfo(restore).size() << " bytes" << Qt::endl;
+        return 0;
+    }
+
     if(!userToken.isEmpty() && parser.positionalArguments().size() > 2) {
         output = parser.positionalArguments().at(2);
     }
 
     const QString snapFile = parser.value(snapParameter);
 
-    if(!output.isEmpty())
+    if(!output.isEmpty() || parser.isSet(findParameter))
         state |= CmdLine;
 
     if(parser.isSet(storeParameter))
@@ -196,6 +250,13 @@ int main(int argc, char *argv[]) {
         parser.showHelp(-2);
     }
 
+    // a capture directory has only the Figma data, settings are as given
+    const auto captureDir = !restore.isEmpty() && QFileInfo(restore).isDir();
+    const auto offline = captureDir || (!restore.isEmpty() && parser.isSet(offlineParameter));
+    if(offline && (!(state & CmdLine) || state & Store)) {
+        parser.showHelp(-16);
+    }
+
      const QString fontFolder = state & CmdLine ?
                  parser.value(fontFolderParameter) :
                  QSettings(COMPANY_NAME, PRODUCT_NAME).value(FONTFOLDER).toString();
@@ -216,6 +277,26 @@ int main(int argc, char *argv[]) {
         if(!ok) parser.showHelp(-13);
     }
 
+    QMap<int, QSet<int>> scope;
+
+    if(parser.isSet(scopeParameter)) {
+        const auto list = parser.value(scopeParameter).split(';', Qt::SkipEmptyParts);
+        for(const auto& item : list) {
+            const auto ce = item.split('-');
+            bool ok;
+            const auto c = ce[0].toInt(&ok);
+            if(!ok || c < 1 || ce.length() > 2) parser.showHelp(-14);
+            auto& elements = scope[c];
+            if(ce.length() == 2) {
+                const auto e = ce[1].toInt(&ok);
+                if(!ok || e < 1) parser.showHelp(-15);
+                elements.insert(e);
+            }
+        }
+    } else if(parser.isSet(showParameter) && !snapFile.isEmpty()) {
+        scope.insert(canvas, {element}); // only the snapped view is needed
+    }
+
 
 #ifndef NO_SSL
     if (!QSslSocket::supportsSsl()) {
@@ -238,10 +319,20 @@ int main(int argc, char *argv[]) {
     }
 
     auto figmaGet = std::make_unique<FigmaGet>();
-    auto figmaQml = std::make_unique<FigmaQml>(dir.path(), fontFolder, *figmaGet);
+    std::unique_ptr<FigmaLocal> figmaLocal;
+    if(offline) {
+        figmaLocal = std::make_unique<FigmaLocal>();
+        if(parser.isSet(latencyParameter))
+            figmaLocal->setProperty("latency", parser.value(latencyParameter));
+    }
+    FigmaProvider& provider = figmaLocal ? static_cast<FigmaProvider&>(*figmaLocal) : *figmaGet;
+    auto figmaQml = std::make_unique<FigmaQml>(dir.path(), fontFolder, provider);
 
     Clipboard clipboard;
-   // figmaQml->setFilter({{1,{2}}});
+    if(!scope.isEmpty()) {
+        figmaGet->setScope(scope);
+        figmaQml->setFilter(scope);
+    }
 
     figmaQml->setBrokenPlaceholder(":/broken_image.jpg");
 
@@ -253,7 +344,7 @@ int main(int argc, char *argv[]) {
     if(state & CmdLine || !snapFile.isEmpty()) {
         unsigned qmlFlags = 0;
 
-        if(restore.isEmpty()) {
+        if(restore.isEmpty() || captureDir) {
             if(parser.isSet(renderFrameParameter))
                 qmlFlags |= FigmaQml::PrerenderFrames;
             if(parser.isSet(breakBooleansParameter))
@@ -292,8 +383,13 @@ int main(int argc, char *argv[]) {
                 figmaQml->setFontMapping(k, v);
         }
 
-        if(parser.isSet(timedParameter))
+        if(parser.isSet(timedParameter)) {
             qmlFlags |= FigmaQml::Timed;
+            Tracer::setEnabled(true);
+        }
+
+        if(parser.isSet(memoryStatsParameter))
+            MemoryStats::setEnabled(true);
 
          if(!userToken.isEmpty())
              figmaGet->setProperty("userToken", userToken);
@@ -308,6 +404,30 @@ int main(int argc, char *argv[]) {
 
          if(parser.isSet(throttleParameter))
             figmaGet->setProperty("throttle", parser.value(throttleParameter));
+
+         if(parser.isSet(concurrencyParameter))
+            figmaGet->setProperty("concurrency", parser.value(concurrencyParameter));
+
+         if(parser.isSet(memoryBudgetParameter))
+            figmaGet->setProperty("memoryBudget", parser.value(memoryBudgetParameter));
+
+         if(parser.isSet(assetCacheParameter))
+            figmaGet->setProperty("assetCacheSize", parser.value(assetCacheParameter));
+
+         if(parser.isSet(apiUrlParameter)) {
+            auto url = parser.value(apiUrlParameter);
+            figmaGet->setProperty("apiUrl", url.endsWith('/') ? url : url + '/');
+         }
+
+         if(parser.isSet(recordParameter) && !figmaGet->record(parser.value(recordParameter))) {
+             ::print() << "Error: Cannot record to " << parser.value(recordParameter) << Qt::endl;
+             return -1;
+         }
+
+         if(parser.isSet(replayParameter) && !figmaGet->replay(parser.value(replayParameter))) {
+             ::print() << "Error: Cannot replay " << parser.value(replayParameter) << Qt::endl;
+             return -1;
+         }
      }
 
 
@@ -336,7 +456,7 @@ int main(int argc, char *argv[]) {
                 app.exit(-2);
             }); //delay must be big enough so all threads notice app.exit side effect is to cease all eventloop.execs!
          });
-         QObject::connect(figmaGet.get(), &FigmaGet::error, [&app, &figmaGet, &supressErrors](const QString& errorString) {
+         const auto connectionError = [&app, &figmaGet, &supressErrors](const QString& errorString) {
             if(supressErrors)
                 return;
             supressErrors = true;
@@ -345,15 +465,19 @@ int main(int argc, char *argv[]) {
             QTimer::singleShot(800, &app, [&app]() {
                 app.exit(-3);
             });  //delay must be big enough so all threads notice app.exit side effect is to cease all eventloop.execs!
-         });
+         };
+         QObject::connect(figmaGet.get(), &FigmaGet::error, connectionError);
+         if(figmaLocal)
+             QObject::connect(figmaLocal.get(), &FigmaLocal::error, connectionError);
 
 
-         QObject::connect(figmaQml.get(), &FigmaQml::sourceCodeChanged, [&figmaQml, &figmaGet, output, &app, state/*, &onDataChange*/]() {
+         const auto findText = parser.value(findParameter);
+         QObject::connect(figmaQml.get(), &FigmaQml::sourceCodeChanged, [&figmaQml, &figmaGet, &provider, output, findText, &app, state/*, &onDataChange*/]() {
              int excode = 0;
              QEventLoop loop;
              QTimer exit;
              QObject::connect(&exit, &QTimer::timeout,[&]() { // correct way is to wait all...
-                 if(!figmaGet->isReady())
+                 if(!provider.isReady())
                      return;
                  if(state & Store) {
                      const auto saveName = output.endsWith(".figmaqml") ? output : output + ".figmaqml";
@@ -371,6 +495,19 @@ int main(int argc, char *argv[]) {
                         excode = -1;
                     }
                  }
+                 if(!findText.isEmpty()) {
+                     const auto hits = figmaQml->find(findText, 0);
+                     ::print() << Qt::endl;
+                     for(const auto& h : hits) {
+                         const auto hit = h.toMap();
+                         const auto canvas = hit["canvas"].toInt();
+                         const auto where = canvas < 0 ? QString("component") : QString("%1-%2").arg(canvas + 1).arg(hit["element"].toInt() + 1);
+                         ::print() << "Found: " << where << " " << hit["file"].toString() << ":" << hit["line"].toInt()
+                                   << " " << hit["kind"].toString() << " \"" << hit["text"].toString() << "\"" << Qt::endl;
+                     }
+                     if(hits.isEmpty())
+                         ::print() << "Not found: " << findText << Qt::endl;
+                 }
                  if(state & ShowFonts) {
                      const auto fonts = figmaQml->fonts();
                      const auto keys = fonts.keys();
@@ -385,16 +522,23 @@ int main(int argc, char *argv[]) {
              QTimer::singleShot(0, &app, [&app, excode](){app.exit(excode);});
          });
 
-         if(!restore.isEmpty()) {
+         if(figmaLocal) {
+             QObject::connect(figmaLocal.get(), &FigmaLocal::restored,
+                              figmaQml.get(), [&figmaLocal, &figmaQml](unsigned flags, const QVariantMap& imports) {
+                 if(!imports.isEmpty())
+                     figmaQml->restore(flags, imports);
+                 figmaQml->createDocumentSources(figmaLocal->data());
+             });
+         } else if(!restore.isEmpty()) {
              QObject::connect(figmaGet.get(), &FigmaGet::restored,
                               figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
 
                  figmaQml->restore(flags, imports);
-                 figmaQml->createDocumentSources(figmaGet->data());
+                 figmaQml->createDocumentSources(figmaGet->document());
              });
          } else {
              onDataChange = [&figmaGet, &figmaQml]() {
-                 figmaQml->createDocumentSources(figmaGet->data());
+                 figmaQml->createDocumentSources(figmaGet->document());
              };
              figmaGet->update();
         }
@@ -408,14 +552,14 @@ int main(int argc, char *argv[]) {
                           figmaQml.get(), [&figmaGet, &figmaQml]() {
              QSettings settings(COMPANY_NAME, PRODUCT_NAME);
              settings.setValue(FLAGS, figmaQml->property("flags").toUInt());
-             figmaQml->createDocumentView(figmaGet->data(), true);
+             figmaQml->createDocumentView(figmaGet->document(), true);
          });
 
          QObject::connect(figmaQml.get(), &FigmaQml::imageDimensionMaxChanged,
                           figmaQml.get(), [&figmaGet, &figmaQml]() {
              QSettings settings(COMPANY_NAME, PRODUCT_NAME);
              settings.setValue(IMAGEMAXSIZE, figmaQml->property("imageDimensionMax").toInt());
-             figmaQml->createDocumentView(figmaGet->data(), true);
+             figmaQml->createDocumentView(figmaGet->document(), true);
          });
 
 
@@ -438,23 +582,23 @@ int main(int argc, char *argv[]) {
          QObject::connect(figmaQml.get(), &FigmaQml::importsChanged, [&figmaQml, &figmaGet]() {
              QSettings settings(COMPANY_NAME, PRODUCT_NAME);
              settings.setValue(IMPORTS, figmaQml->property("imports").toMap());
-             figmaQml->createDocumentView(figmaGet->data(), true);
+             figmaQml->createDocumentView(figmaGet->document(), true);
          });
 
          QObject::connect(figmaQml.get(), &FigmaQml::fontFolderChanged, [&figmaQml, &figmaGet]() {
              QSettings settings(COMPANY_NAME, PRODUCT_NAME);
              settings.setValue(FONTFOLDER, figmaQml->property("fontFolder").toString());
-             figmaQml->createDocumentView(figmaGet->data(), true);
+             figmaQml->createDocumentView(figmaGet->document(), true);
          });
 
          QObject::connect(figmaGet.get(), &FigmaGet::restored,
                           figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
              figmaQml->restore(flags, imports);
-             figmaQml->createDocumentView(figmaGet->data(), false);
+             figmaQml->createDocumentView(figmaGet->document(), false);
          });
 
          QObject::connect(figmaQml.get(), &FigmaQml::refresh, figmaGet.get(), [&figmaQml, &figmaGet](){
-              figmaQml->createDocumentView(figmaGet->data(), true);
+              figmaQml->createDocumentView(figmaGet->document(), true);
          });
 
          QSettings settings(COMPANY_NAME, PRODUCT_NAME);
@@ -462,6 +606,8 @@ int main(int argc, char *argv[]) {
          figmaGet->setProperty("projectToken", settings.value(PROJECT_TOKEN));
          figmaGet->setProperty("userToken", settings.value(USER_TOKEN));
          figmaGet->setProperty("throttle", settings.value(THROTTLE, 300));
+         figmaGet->setProperty("memoryBudget", settings.value(MEMORY_BUDGET, 512));
+         figmaGet->setProperty("assetCacheSize", settings.value(ASSET_CACHE, 1024));
          figmaQml->setProperty("flags", settings.value(FLAGS, 0).toUInt());
          figmaQml->setProperty("imports", settings.value(IMPORTS, figmaQml->defaultImports()).toMap());
 
@@ -489,11 +635,11 @@ int main(int argc, char *argv[]) {
              QObject::connect(figmaGet.get(), &FigmaGet::restored,
                               figmaQml.get(), [&figmaGet, &figmaQml](unsigned flags, const QVariantMap& imports) {
                   figmaQml->restore(flags, imports);
-                  figmaQml->createDocumentView(figmaGet->data(), false);
+                  figmaQml->createDocumentView(figmaGet->document(), false);
              });
          } else {
              onDataChange = [&figmaGet, &figmaQml]() {
-                 figmaQml->createDocumentView(figmaGet->data(), false);
+                 figmaQml->createDocumentView(figmaGet->document(), false);
              };
              figmaGet->update();
          }
@@ -505,10 +651,10 @@ int main(int argc, char *argv[]) {
 
     if(!(state & CmdLine)) {
          onDataChange = [&figmaGet, &figmaQml]() {
-                      figmaQml->createDocumentView(figmaGet->data(), true);
+                      figmaQml->createDocumentView(figmaGet->document(), true);
                   };
 
-        QObject::connect(figmaQml.get(), &FigmaQml::documentCreated, figmaGet.get(), &FigmaGet::documentCreated);
+        QObject::connect(figmaQml.get(), &FigmaQml::documentCompleted, figmaGet.get(), &FigmaGet::documentCreated);
 
         if(parser.isSet(showParameter)) {
                 auto connection = std::make_shared<QMetaObject::Connection>();
@@ -592,12 +738,20 @@ int main(int argc, char *argv[]) {
                       &onDataChange, &Execute::execute, Qt::QueuedConnection);
 
 
-     if(!restore.isEmpty()) {
+     if(figmaLocal) {
+         figmaLocal->restore(restore);
+     } else if(!restore.isEmpty()) {
          figmaGet->restore(restore);
      }
 
     //qDebug()  << "FOO: start app" << dir.path();
     const auto return_value = app.exec();
+    if(const auto traceFile = parser.value(timedParameter); !traceFile.isEmpty()) {
+        if(!Tracer::write(traceFile))
+            ::print() << "Error: Cannot write trace " << traceFile << Qt::endl;
+    }
+    if(MemoryStats::isEnabled())
+        ::print() << "\nMemory:\n" << MemoryStats::report() << Qt::flush;
     //qDebug()  << "FOO: exit app" << dir.path();
     return return_value;
 }
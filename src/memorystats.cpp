@@ -0,0 +1,244 @@
+#include "memorystats.h"
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#ifdef MEMORY_STATS
+#include <malloc.h>
+#define COUNT_ALLOCATIONS
+#endif
+#endif
+
+namespace {
+// plain thread locals, these are used from within malloc
+thread_local qint64 allocations = 0;
+thread_local qint64 allocated = 0;
+thread_local qint64 live = 0;
+thread_local MemoryStats::Stage* current = nullptr;
+std::atomic<qint64> liveTotal{0};
+
+struct StageStats {
+    const char* name;
+    qint64 calls = 0;
+    qint64 allocations = 0;
+    qint64 allocated = 0;
+    qint64 live = 0;
+    qint64 peakRaise = 0;   // how much the process high water mark grew within
+};
+
+struct Stats {
+    QMutex mutex;
+    std::vector<StageStats> stages; // in order of appearance
+    std::atomic_bool enabled = false;
+};
+
+Stats& stats() {
+    static Stats s;
+    return s;
+}
+
+qint64 statusValue(const QByteArray& key) {
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if(!status.open(QIODevice::ReadOnly))
+        return 0;
+    const auto lines = status.readAll().split('\n');
+    for(const auto& line : lines) {
+        if(line.startsWith(key)) // e.g. "VmRSS:     12345 kB"
+            return line.mid(key.size()).trimmed().split(' ').first().toLongLong() * 1024;
+    }
+#else
+    Q_UNUSED(key);
+#endif
+    return 0;
+}
+
+QString kB(qint64 bytes) {
+    return QString::number(bytes / 1024) + " kB";
+}
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+// glibc exports its allocator under these names, the ones below override malloc for
+// the whole process, including Qt containers and operator new. Every entry point that
+// glibc does not route through malloc is overridden, as all of them are freed by free below.
+// When built in every block is counted, also without --memory-stats, otherwise blocks allocated
+// before enabling would be subtracted on free. Hence MEMORY_STATS is off by default.
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* ptr, std::size_t size);
+void* __libc_memalign(std::size_t align, std::size_t size);
+void* __libc_valloc(std::size_t size);
+void* __libc_pvalloc(std::size_t size);
+void __libc_free(void* ptr);
+}
+
+static void* counted(void* ptr) {
+    if(!ptr)
+        return ptr;
+    const auto size = static_cast<qint64>(malloc_usable_size(ptr));
+    ++allocations;
+    allocated += size;
+    live += size;
+    liveTotal.fetch_add(size, std::memory_order_relaxed);
+    return ptr;
+}
+
+static void uncounted(void* ptr) {
+    if(!ptr)
+        return;
+    const auto size = static_cast<qint64>(malloc_usable_size(ptr));
+    live -= size; // may be allocated by another thread
+    liveTotal.fetch_sub(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+void* malloc(std::size_t size) noexcept {return counted(__libc_malloc(size));}
+void* calloc(std::size_t count, std::size_t size) noexcept {return counted(__libc_calloc(count, size));}
+void* memalign(std::size_t align, std::size_t size) noexcept {return counted(__libc_memalign(align, size));}
+void* aligned_alloc(std::size_t align, std::size_t size) noexcept {return counted(__libc_memalign(align, size));}
+int posix_memalign(void** ptr, std::size_t align, std::size_t size) noexcept {
+    if(align < sizeof(void*) || (align & (align - 1)) != 0)
+        return EINVAL;
+    *ptr = counted(__libc_memalign(align, size));
+    return *ptr || !size ? 0 : ENOMEM;
+}
+void* realloc(void* ptr, std::size_t size) noexcept {
+    uncounted(ptr);
+    auto moved = __libc_realloc(ptr, size);
+    if(!moved && ptr && size) {
+        counted(ptr); // failed, the old block is still there
+        return nullptr;
+    }
+    return counted(moved);
+}
+void* reallocarray(void* ptr, std::size_t count, std::size_t size) noexcept {
+    std::size_t bytes;
+    if(__builtin_mul_overflow(count, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, bytes);
+}
+void* valloc(std::size_t size) noexcept {return counted(__libc_valloc(size));}
+void* pvalloc(std::size_t size) noexcept {return counted(__libc_pvalloc(size));}
+void free(void* ptr) noexcept {
+    uncounted(ptr);
+    __libc_free(ptr);
+}
+}
+
+#endif
+
+void MemoryStats::setEnabled(bool enabled) {
+    stats().enabled = enabled;
+}
+
+bool MemoryStats::isEnabled() {
+    return stats().enabled;
+}
+
+bool MemoryStats::hasHeap() {
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+MemoryStats::Heap MemoryStats::heap() {
+    return {allocations, allocated, live};
+}
+
+qint64 MemoryStats::liveHeap() {
+    return liveTotal.load(std::memory_order_relaxed);
+}
+
+qint64 MemoryStats::rss() {
+    return statusValue("VmRSS:");
+}
+
+qint64 MemoryStats::peakRss() {
+#ifdef Q_OS_LINUX
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+        return static_cast<qint64>(usage.ru_maxrss) * 1024; // no allocations, unlike reading /proc
+#endif
+    return statusValue("VmHWM:");
+}
+
+MemoryStats::Stage::Stage(const char* name) : m_name(name) {
+    if(!MemoryStats::isEnabled())
+        return;
+    m_parent = current;
+    current = this;
+    m_start = MemoryStats::heap();
+    m_startPeak = MemoryStats::peakRss();
+    m_active = true;
+}
+
+MemoryStats::Stage::~Stage() {
+    if(!m_active)
+        return;
+    const auto end = MemoryStats::heap();
+    const auto peakRaise = MemoryStats::peakRss() - m_startPeak;
+    const Heap total{end.allocations - m_start.allocations,
+                     end.allocated - m_start.allocated,
+                     end.live - m_start.live};
+    MemoryStats::add(m_name, {total.allocations - m_nested.allocations,
+                              total.allocated - m_nested.allocated,
+                              total.live - m_nested.live}, peakRaise - m_nestedPeak);
+    current = m_parent;
+    if(m_parent) {
+        m_parent->m_nested.allocations += total.allocations;
+        m_parent->m_nested.allocated += total.allocated;
+        m_parent->m_nested.live += total.live;
+        m_parent->m_nestedPeak += peakRaise;
+    }
+}
+
+void MemoryStats::add(const char* name, const Heap& heap, qint64 peakRaise) {
+    auto& s = stats();
+    QMutexLocker locker(&s.mutex);
+    auto it = std::find_if(s.stages.begin(), s.stages.end(), [name](const auto& stage) {
+        return qstrcmp(stage.name, name) == 0;
+    });
+    if(it == s.stages.end()) {
+        s.stages.push_back({name});
+        it = s.stages.end() - 1;
+    }
+    ++it->calls;
+    it->allocations += heap.allocations;
+    it->allocated += heap.allocated;
+    it->live += heap.live;
+    it->peakRaise += peakRaise;
+}
+
+QString MemoryStats::report() {
+    QString str;
+    QTextStream stream(&str);
+    auto& s = stats();
+    QMutexLocker locker(&s.mutex);
+    for(const auto& stage : s.stages) {
+        stream << stage.name << ": calls " << stage.calls;
+        if(hasHeap())
+            stream << ", allocations " << stage.allocations
+                   << ", allocated " << kB(stage.allocated)
+                   << ", live " << (stage.live >= 0 ? "+" : "") << kB(stage.live);
+        stream << ", peak RSS +" << kB(stage.peakRaise) << Qt::endl;
+    }
+    if(hasHeap())
+        stream << "Live heap " << kB(liveHeap()) << ", ";
+    stream << "RSS " << kB(rss()) << ", peak RSS " << kB(peakRss()) << Qt::endl;
+    return str;
+}
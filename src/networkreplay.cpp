@@ -0,0 +1,188 @@
+#include "networkreplay.h"
+#include <QNetworkReply>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <QFileInfo>
+#include <cstring>
+
+constexpr auto TrafficFile = "traffic.jsonl";
+constexpr auto BodyFolder = "bodies";
+
+TrafficRecorder::TrafficRecorder(const QString& dirName) : m_dir(dirName) {
+    if(m_dir.mkpath(BodyFolder))
+        m_index.setFileName(m_dir.filePath(TrafficFile));
+    m_index.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    m_elapsed.start();
+}
+
+bool TrafficRecorder::isValid() const {
+    return m_index.isOpen();
+}
+
+QString TrafficRecorder::errorString() const {
+    return m_index.errorString();
+}
+
+// writes the index line, returns a name for the body
+QString TrafficRecorder::write(QNetworkReply* reply, qint64 ms) {
+    const auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    const auto body = QString("%1/%2").arg(BodyFolder).arg(m_count++);
+    const QJsonObject line {
+        {"url", reply->request().url().toString()},
+        {"status", status.isValid() ? status.toInt() : 0},
+        {"error", static_cast<int>(reply->error())},
+        {"errorString", reply->error() == QNetworkReply::NoError ? QString() : reply->errorString()},
+        {"retryAfter", QString::fromLatin1(reply->rawHeader("Retry-After"))},
+        {"started", m_elapsed.elapsed() - ms},
+        {"ms", ms},
+        {"body", body}
+    };
+    m_index.write(QJsonDocument(line).toJson(QJsonDocument::Compact) + '\n');
+    m_index.flush(); // a slow run can be inspected while going
+    return body;
+}
+
+void TrafficRecorder::record(QNetworkReply* reply, qint64 ms, const QByteArray& body) {
+    if(!isValid())
+        return;
+    QFile file(m_dir.filePath(write(reply, ms)));
+    if(file.open(QIODevice::WriteOnly))
+        file.write(body);
+}
+
+void TrafficRecorder::record(QNetworkReply* reply, qint64 ms, QFile& body) {
+    if(!isValid())
+        return;
+    body.flush();
+    QFile::copy(body.fileName(), m_dir.filePath(write(reply, ms)));
+}
+
+class ReplayReply : public QNetworkReply {
+public:
+    ReplayReply(const QNetworkRequest& request, const ReplayAccessManager::Response& response, const QByteArray& body, QObject* parent) :
+        QNetworkReply(parent), m_response(response), m_body(body) {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(QNetworkAccessManager::GetOperation);
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        QTimer::singleShot(response.ms, this, &ReplayReply::respond);
+    }
+
+    void abort() override {
+        if(isFinished())
+            return;
+        setError(OperationCanceledError, "Operation canceled");
+        emit errorOccurred(OperationCanceledError);
+        setFinished(true);
+        emit finished();
+    }
+
+    qint64 bytesAvailable() const override {
+        return m_body.size() - m_offset + QIODevice::bytesAvailable();
+    }
+
+    bool isSequential() const override {
+        return true;
+    }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        const auto len = std::min<qint64>(maxSize, m_body.size() - m_offset);
+        if(len <= 0)
+            return isFinished() ? -1 : 0;
+        std::memcpy(data, m_body.constData() + m_offset, len);
+        m_offset += len;
+        return len;
+    }
+
+private:
+    void respond() {
+        if(isFinished())
+            return;
+        if(m_response.status > 0)
+            setAttribute(QNetworkRequest::HttpStatusCodeAttribute, m_response.status);
+        if(!m_response.retryAfter.isEmpty())
+            setRawHeader("Retry-After", m_response.retryAfter);
+        if(!m_body.isEmpty()) {
+            emit downloadProgress(m_body.size(), m_body.size());
+            emit readyRead();
+        }
+        if(m_response.error != NoError) {
+            setError(static_cast<NetworkError>(m_response.error), m_response.errorString);
+            emit errorOccurred(error());
+        }
+        setFinished(true);
+        emit finished();
+    }
+
+private:
+    const ReplayAccessManager::Response m_response;
+    const QByteArray m_body;
+    qint64 m_offset = 0;
+};
+
+// responses in recorded order
+std::optional<QVector<TrafficRecorder::Response>> TrafficRecorder::read(const QDir& dir, QString& errorString) {
+    QFile index(dir.filePath(TrafficFile));
+    if(!index.open(QIODevice::ReadOnly)) {
+        errorString = index.errorString() + " " + index.fileName();
+        return std::nullopt;
+    }
+    QVector<Response> responses;
+    while(!index.atEnd()) {
+        const auto line = index.readLine().trimmed();
+        if(line.isEmpty())
+            continue;
+        QJsonParseError err;
+        const auto obj = QJsonDocument::fromJson(line, &err).object();
+        if(err.error != QJsonParseError::NoError) {
+            errorString = QString("Invalid %1: %2").arg(index.fileName(), err.errorString());
+            return std::nullopt;
+        }
+        responses.append({obj["url"].toString(),
+                          obj["status"].toInt(),
+                          obj["error"].toInt(),
+                          obj["errorString"].toString(),
+                          obj["retryAfter"].toString().toLatin1(),
+                          obj["ms"].toInteger(),
+                          obj["body"].toString()});
+    }
+    return responses;
+}
+
+bool TrafficRecorder::isRecording(const QString& dirName) {
+    return QFileInfo::exists(QDir(dirName).filePath(TrafficFile));
+}
+
+ReplayAccessManager::ReplayAccessManager(const QString& dirName, QObject* parent) : QNetworkAccessManager(parent), m_dir(dirName) {
+    const auto responses = TrafficRecorder::read(m_dir, m_errorString);
+    if(!responses)
+        return;
+    for(const auto& response : *responses)
+        m_responses[response.url].append(response);
+}
+
+bool ReplayAccessManager::isValid() const {
+    return m_errorString.isEmpty();
+}
+
+QString ReplayAccessManager::errorString() const {
+    return m_errorString;
+}
+
+// each url gets its responses in recorded order, the last one repeats
+QNetworkReply* ReplayAccessManager::createRequest(Operation, const QNetworkRequest& request, QIODevice*) {
+    const auto url = request.url().toString();
+    const auto it = m_responses.find(url);
+    if(it == m_responses.end()) {
+        const Response notFound{url, 404, QNetworkReply::ContentNotFoundError, "Not recorded " + url, {}, 0, {}};
+        return new ReplayReply(request, notFound, {}, this);
+    }
+    auto& next = m_next[url];
+    const auto& response = (*it)[std::min(next, static_cast<int>(it->size()) - 1)];
+    ++next;
+    QFile file(m_dir.filePath(response.body));
+    const auto body = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    return new ReplayReply(request, response, body, this);
+}
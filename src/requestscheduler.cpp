@@ -0,0 +1,157 @@
+#include "requestscheduler.h"
+#include <QNetworkReply>
+#include <QDateTime>
+#include <algorithm>
+#include <cmath>
+
+using namespace std::chrono_literals;
+
+constexpr auto MaxPenalty = 16.;
+constexpr auto PenaltyRecovery = 0.25;   // per successful API call
+constexpr auto DefaultRetry = 1000ms;    // when server does not tell, doubles with penalty
+constexpr auto MaxRetry = 60000ms;
+
+RequestScheduler::RequestScheduler(QObject* parent) : QObject(parent) {
+    m_timer.setSingleShot(true);
+    QObject::connect(&m_timer, &QTimer::timeout, this, &RequestScheduler::dispatch);
+    m_clock.start();
+    m_tokens = m_burst;
+}
+
+void RequestScheduler::setConcurrency(int concurrency) {
+    m_concurrency = std::max(1, concurrency);
+    schedule(0ms);
+}
+
+void RequestScheduler::setInterval(int ms) {
+    refill();
+    m_interval = std::max(0, ms);
+    schedule(0ms);
+}
+
+void RequestScheduler::setBurst(int tokens) {
+    m_burst = std::max(1, tokens);
+    m_tokens = std::min<double>(m_tokens, m_burst);
+}
+
+void RequestScheduler::enqueue(const NetworkFunction& call, Kind kind) {
+    (kind == Kind::Api ? m_api : m_content).enqueue({call, kind});
+    schedule(0ms); // lets calls queued within the same event loop round be dispatched (and batched) together
+}
+
+void RequestScheduler::retry(Call call, const std::optional<std::chrono::milliseconds>& retryAfter) {
+    call.notBefore = m_clock.elapsed() + backoff(retryAfter).count();
+    (call.kind == Kind::Api ? m_api : m_content).prepend(call);
+}
+
+bool RequestScheduler::isEmpty() const {
+    return m_api.isEmpty() && m_content.isEmpty();
+}
+
+void RequestScheduler::clear() {
+    m_timer.stop();
+    m_api.clear();
+    m_content.clear();
+    m_penalty = 1;
+    m_pausedUntil = 0;
+    m_tokens = m_burst;
+    m_refilled = m_clock.elapsed();
+}
+
+std::optional<std::chrono::milliseconds> RequestScheduler::retryAfter(const QNetworkReply* reply) {
+    const auto value = reply->rawHeader("Retry-After").trimmed();
+    if(value.isEmpty())
+        return std::nullopt;
+    bool ok;
+    const auto seconds = value.toLongLong(&ok);
+    if(ok)
+        return std::chrono::milliseconds(std::max(0LL, seconds) * 1000);
+    const auto date = QDateTime::fromString(QString::fromLatin1(value), Qt::RFC2822Date);
+    if(date.isValid())
+        return std::chrono::milliseconds(std::max(0LL, QDateTime::currentDateTimeUtc().msecsTo(date)));
+    return std::nullopt;
+}
+
+std::chrono::milliseconds RequestScheduler::tokenInterval() const {
+    return std::chrono::milliseconds(static_cast<qint64>(m_interval * m_penalty));
+}
+
+void RequestScheduler::refill() {
+    const auto now = m_clock.elapsed();
+    const auto interval = tokenInterval().count();
+    m_tokens = interval > 0 ? std::min<double>(m_burst, m_tokens + static_cast<double>(now - m_refilled) / interval) : m_burst;
+    m_refilled = now;
+}
+
+void RequestScheduler::schedule(std::chrono::milliseconds delay) {
+    if(!m_timer.isActive() || m_timer.remainingTime() > delay.count())
+        m_timer.start(delay);
+}
+
+std::chrono::milliseconds RequestScheduler::backoff(const std::optional<std::chrono::milliseconds>& retryAfter) {
+    refill();
+    m_penalty = std::min(MaxPenalty, m_penalty * 2);
+    m_tokens = 0;
+    const auto wait = retryAfter ? *retryAfter : std::min(MaxRetry, std::chrono::milliseconds(static_cast<qint64>(DefaultRetry.count() * m_penalty)));
+    m_pausedUntil = std::max(m_pausedUntil, m_clock.elapsed() + wait.count());
+    emit throttled();
+    schedule(wait);
+    return wait;
+}
+
+void RequestScheduler::dispatch() {
+    refill();
+    const auto now = m_clock.elapsed();
+    while(inFlight() < m_concurrency && !isEmpty()) {
+        const auto apiReady = !m_api.isEmpty() && now >= m_pausedUntil && m_tokens >= 1;
+        if(apiReady) {
+            m_tokens -= 1;
+            start(m_api.dequeue());
+        } else if(!m_content.isEmpty() && now >= m_content.head().notBefore) {
+            start(m_content.dequeue());
+        } else {
+            break;
+        }
+    }
+    if(inFlight() >= m_concurrency)
+        return; // continued when a request is finished
+    if(!m_content.isEmpty() && now < m_content.head().notBefore)
+        schedule(std::chrono::milliseconds(m_content.head().notBefore - now));
+    if(m_api.isEmpty())
+        return; // continued when a request is enqueued
+    if(now < m_pausedUntil) {
+        schedule(std::chrono::milliseconds(m_pausedUntil - now));
+    } else {
+        const auto missing = 1. - m_tokens;
+        schedule(std::chrono::milliseconds(static_cast<qint64>(std::ceil(missing * tokenInterval().count()))));
+    }
+}
+
+void RequestScheduler::start(const Call& call) {
+    auto reply = call.call();
+    if(!reply) { // nothing was requested, e.g. a batch was already sent
+        if(call.kind == Kind::Api)
+            m_tokens += 1;
+        return;
+    }
+    m_inFlight.insert(reply, {call.call, call.kind});
+    QObject::connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        finished(reply);
+    });
+    emit dispatched(reply, call.call);
+}
+
+void RequestScheduler::finished(QNetworkReply* reply) {
+    const auto call = m_inFlight.take(reply);
+    const auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    // handled here, as reply errors are seen by the caller only after the call is gone
+    if(status.isValid() && (status.toInt() == 429 || status.toInt() == 400)) {
+        retry(call, retryAfter(reply));
+        return;
+    }
+    if(call.kind == Kind::Api && reply->error() == QNetworkReply::NoError) {
+        refill();
+        m_penalty = std::max(1., m_penalty - PenaltyRecovery);
+    }
+    schedule(0ms);
+}
@@ -0,0 +1,102 @@
+#include "searchindex.h"
+#include <QSet>
+#include <algorithm>
+#include <tuple>
+
+void SearchIndex::clear() {
+    m_hits.clear();
+    m_removed.clear();
+    m_files.clear();
+    m_words.clear();
+    m_count = 0;
+}
+
+int SearchIndex::size() const {
+    return m_count;
+}
+
+QString SearchIndex::kindName(Kind kind) {
+    switch(kind) {
+    case Kind::Name: return "name";
+    case Kind::Id: return "id";
+    case Kind::Text: return "text";
+    case Kind::Component: return "component";
+    case Kind::Instance: return "instance";
+    case Kind::Image: return "image";
+    }
+    return QString();
+}
+
+// lower case runs of letters and digits, e.g. an id "12:34" is "12" and "34"
+QStringList SearchIndex::words(const QString& text) {
+    QStringList list;
+    qsizetype begin = -1;
+    for(qsizetype i = 0; i <= text.size(); ++i) {
+        const auto isWord = i < text.size() && text[i].isLetterOrNumber();
+        if(isWord && begin < 0)
+            begin = i;
+        else if(!isWord && begin >= 0) {
+            list.append(text.mid(begin, i - begin).toLower());
+            begin = -1;
+        }
+    }
+    return list;
+}
+
+// a file generated again replaces its earlier hits
+void SearchIndex::insert(const QString& file, const QVector<Hit>& hits) {
+    auto& fileHits = m_files[file];
+    for(const auto index : std::as_const(fileHits)) {
+        m_removed[index] = true;
+        --m_count;
+    }
+    fileHits.clear();
+    for(const auto& hit : hits) {
+        const auto index = static_cast<int>(m_hits.size());
+        m_hits.append(hit);
+        m_removed.append(false);
+        fileHits.append(index);
+        const auto hitWords = words(hit.text);
+        for(const auto& word : hitWords)
+            m_words[word].append(index);
+        ++m_count;
+    }
+}
+
+// ordered as in the document, components last, max <= 0 is all
+QVector<SearchIndex::Hit> SearchIndex::find(const QString& query, int max) const {
+    const auto queryWords = words(query);
+    if(queryWords.isEmpty())
+        return {};
+    QSet<int> matches;
+    for(qsizetype i = 0; i < queryWords.size(); ++i) {
+        const auto& word = queryWords[i];
+        QSet<int> found;
+        for(auto it = m_words.lowerBound(word); it != m_words.constEnd() && it.key().startsWith(word); ++it) {
+            for(const auto index : it.value()) {
+                if(!m_removed[index] && (i == 0 || matches.contains(index)))
+                    found.insert(index);
+            }
+        }
+        if(found.isEmpty())
+            return {};
+        matches.swap(found);
+    }
+
+    QVector<int> indices(matches.begin(), matches.end());
+    std::sort(indices.begin(), indices.end(), [this](int a, int b) {
+        const auto& ha = m_hits[a];
+        const auto& hb = m_hits[b];
+        const auto ca = ha.canvas < 0;
+        const auto cb = hb.canvas < 0;
+        return std::tie(ca, ha.canvas, ha.element, ha.file, ha.line, a)
+                < std::tie(cb, hb.canvas, hb.element, hb.file, hb.line, b);
+    });
+    if(max > 0 && indices.size() > max)
+        indices.resize(max);
+    QVector<Hit> hits;
+    hits.reserve(indices.size());
+    for(const auto index : indices)
+        hits.append(m_hits[index]);
+    return hits;
+}
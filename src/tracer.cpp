@@ -0,0 +1,153 @@
+#include "tracer.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
+#include <QThread>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QCoreApplication>
+#include <atomic>
+#include <vector>
+
+namespace {
+struct Event {
+    const char* category;
+    QString name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+    int count;
+};
+
+struct Trace {
+    QMutex mutex;
+    QElapsedTimer clock;
+    std::vector<Event> events;
+    QHash<Qt::HANDLE, int> threads;
+    std::atomic_bool enabled = false;
+};
+
+Trace& trace() {
+    static Trace t;
+    return t;
+}
+
+thread_local Tracer::Totals* currentTotals = nullptr;
+thread_local Tracer::Sum* currentSum = nullptr;
+}
+
+Tracer::Totals::Totals(const char* category) : m_category(category) {
+    if(!Tracer::isEnabled())
+        return;
+    m_start = Tracer::now();
+    m_previous = currentTotals;
+    currentTotals = this;
+}
+
+// laid one after another from the start, they are not in order of time but fit within
+Tracer::Totals::~Totals() {
+    if(m_start < 0)
+        return;
+    currentTotals = m_previous;
+    auto start = m_start;
+    for(auto it = m_totals.constBegin(); it != m_totals.constEnd(); ++it) {
+        Tracer::add(m_category, it.key(), start, it->duration, it->count);
+        start += it->duration;
+    }
+}
+
+Tracer::Sum::Sum(const QString& name) : m_totals(currentTotals) {
+    if(!m_totals)
+        return;
+    m_name = name;
+    m_parent = currentSum;
+    currentSum = this;
+    m_start = Tracer::now();
+}
+
+Tracer::Sum::~Sum() {
+    if(!m_totals)
+        return;
+    const auto elapsed = Tracer::now() - m_start;
+    currentSum = m_parent;
+    if(m_parent && m_parent->m_totals == m_totals)
+        m_parent->m_nested += elapsed;
+    auto& total = m_totals->m_totals[m_name];
+    total.duration += elapsed - m_nested;
+    ++total.count;
+}
+
+void Tracer::setEnabled(bool enabled) {
+    auto& t = trace();
+    QMutexLocker locker(&t.mutex);
+    if(enabled && !t.clock.isValid())
+        t.clock.start();
+    t.enabled = enabled;
+}
+
+bool Tracer::isEnabled() {
+    return trace().enabled;
+}
+
+qint64 Tracer::now() {
+    auto& t = trace();
+    QMutexLocker locker(&t.mutex); // clear() restarts the clock
+    return t.clock.isValid() ? t.clock.nsecsElapsed() / 1000 : 0;
+}
+
+void Tracer::add(const char* category, const QString& name, qint64 start) {
+    if(!trace().enabled)
+        return;
+    add(category, name, start, now() - start, 0);
+}
+
+void Tracer::add(const char* category, const QString& name, qint64 start, qint64 duration, int count) {
+    auto& t = trace();
+    if(!t.enabled)
+        return;
+    QMutexLocker locker(&t.mutex);
+    const auto handle = QThread::currentThreadId();
+    auto it = t.threads.find(handle);
+    if(it == t.threads.end())
+        it = t.threads.insert(handle, t.threads.size() + 1);
+    t.events.push_back({category, name, start, duration, it.value(), count});
+}
+
+void Tracer::clear() {
+    auto& t = trace();
+    QMutexLocker locker(&t.mutex);
+    t.events.clear();
+    t.clock.restart();
+}
+
+QByteArray Tracer::toJson() {
+    auto& t = trace();
+    QMutexLocker locker(&t.mutex);
+    QJsonArray events;
+    const auto pid = static_cast<qint64>(QCoreApplication::applicationPid());
+    for(const auto& e : t.events) {
+        QJsonObject event{
+            {"name", e.name},
+            {"cat", e.category},
+            {"ph", "X"},
+            {"ts", e.start},
+            {"dur", e.duration},
+            {"pid", pid},
+            {"tid", e.thread}
+        };
+        if(e.count > 0)
+            event.insert("args", QJsonObject{{"count", e.count}});
+        events.append(event);
+    }
+    return QJsonDocument(QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}}).toJson(QJsonDocument::Compact);
+}
+
+bool Tracer::write(const QString& fileName) {
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    return file.write(toJson()) >= 0;
+}
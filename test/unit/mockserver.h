@@ -0,0 +1,62 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QUrl>
+
+// answers each request with the next queued response of its path (query excluded), 200 when none left
+class MockServer : public QObject {
+    Q_OBJECT
+public:
+    struct Response {
+        Response(int status, const QByteArray& headers = {}, const QByteArray& body = {}) : status(status), headers(headers), body(body) {}
+        int status;
+        QByteArray headers;
+        QByteArray body;    // a placeholder if empty
+    };
+    MockServer() {
+        QObject::connect(&m_server, &QTcpServer::newConnection, this, &MockServer::accept);
+        m_server.listen(QHostAddress::LocalHost);
+        m_clock.start();
+    }
+    QUrl url(const QString& path) const {
+        return QUrl(QString("http://127.0.0.1:%1%2").arg(m_server.serverPort()).arg(path));
+    }
+    void respond(const QString& path, const Response& response) {m_responses[path].append(response);}
+    QList<qint64> hits(const QString& path) const {return m_hits.value(path);}
+    // request targets with their queries, in the order received
+    QStringList targets(const QString& path) const {return m_targets.value(path);}
+private:
+    void accept() {
+        while(auto socket = m_server.nextPendingConnection()) {
+            QObject::connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+                m_requests[socket] += socket->readAll();
+                if(!m_requests[socket].contains("\r\n\r\n"))
+                    return;
+                const auto target = QString::fromLatin1(m_requests.take(socket).split(' ').value(1));
+                const auto path = target.section('?', 0, 0);
+                m_hits[path].append(m_clock.elapsed());
+                m_targets[path].append(target);
+                const auto response = m_responses[path].isEmpty() ? Response(200) : m_responses[path].takeFirst();
+                const QByteArray body = !response.body.isEmpty() ? response.body : response.status == 200 ? "ok" : "no";
+                socket->write("HTTP/1.1 " + QByteArray::number(response.status) + " X\r\n"
+                              + "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                              + "Connection: close\r\n" + response.headers + "\r\n" + body);
+                socket->disconnectFromHost();
+            });
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    }
+private:
+    QTcpServer m_server;
+    QElapsedTimer m_clock;
+    QHash<QTcpSocket*, QByteArray> m_requests;
+    QHash<QString, QList<Response>> m_responses;
+    QHash<QString, QList<qint64>> m_hits;
+    QHash<QString, QStringList> m_targets;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,102 @@
+#include "downloads.h"
+#include <QTest>
+#include <QSignalSpy>
+#include <QNetworkReply>
+
+// a reply that never touches the network, only its lifetime matters
+class FakeReply : public QNetworkReply {
+    Q_OBJECT
+public:
+    FakeReply() {open(QIODevice::ReadOnly);}
+    void abort() override {}
+protected:
+    qint64 readData(char*, qint64) override {return -1;}
+};
+
+class TestDownloads : public QObject {
+    Q_OBJECT
+private slots:
+    void categories();
+    void categoryMoved();
+    void finishedKeepsTotals();
+    void startAndEndPerReply();
+private:
+    static qint64 value(const Downloads& downloads, const QString& category, const QString& key) {
+        return downloads.categories().value(category).toMap().value(key).toLongLong();
+    }
+};
+
+void TestDownloads::categories() {
+    Downloads downloads(nullptr);
+    QSignalSpy changed(&downloads, &Downloads::categoriesChanged);
+    FakeReply image, nodes;
+    downloads.setProgress(&image, 10, 100, Downloads::Images);
+    downloads.setProgress(&nodes, 5, 50, Downloads::Nodes);
+    downloads.setProgress(&image, 40, 100, Downloads::Images);
+    downloads.setProgress(nullptr, 20, 20, Downloads::Document); // read from a file, not a download
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(downloads.categories().keys(), (QStringList{"document", "images", "nodes"}));
+    QCOMPARE(value(downloads, "images", "bytesReceived"), 40);
+    QCOMPARE(value(downloads, "images", "bytesTotal"), 100);
+    QCOMPARE(value(downloads, "images", "downloads"), 1);
+    QCOMPARE(value(downloads, "nodes", "bytesReceived"), 5);
+    QCOMPARE(value(downloads, "document", "bytesReceived"), 20);
+    QCOMPARE(value(downloads, "document", "downloads"), 0);
+    QCOMPARE(downloads.bytesReceived(), 65);
+    QCOMPARE(downloads.bytesTotal(), 170);
+    QCOMPARE(downloads.downloads(), 2);
+}
+
+// a reply monitored before its category is known is counted as Other until then
+void TestDownloads::categoryMoved() {
+    Downloads downloads(nullptr);
+    QSignalSpy changed(&downloads, &Downloads::categoriesChanged);
+    FakeReply reply;
+    downloads.monitor(&reply, []() {return nullptr;});
+    QTRY_COMPARE(changed.count(), 1);
+    QCOMPARE(downloads.categories().keys(), QStringList{"other"});
+    downloads.setProgress(&reply, 10, 10, Downloads::Renderings);
+    QTRY_COMPARE(changed.count(), 2);
+    QCOMPARE(downloads.categories().keys(), QStringList{"renderings"});
+    QCOMPARE(value(downloads, "renderings", "bytesReceived"), 10);
+    QCOMPARE(value(downloads, "renderings", "downloads"), 1);
+    QCOMPARE(downloads.downloads(), 1);
+}
+
+void TestDownloads::finishedKeepsTotals() {
+    Downloads downloads(nullptr);
+    auto reply = new FakeReply;
+    downloads.setProgress(reply, 30, 30, Downloads::Nodes);
+    QCOMPARE(downloads.activeDownloads(), 1);
+    delete reply;
+    QCOMPARE(downloads.activeDownloads(), 0);
+    QVERIFY(!downloads.downloading());
+    QTRY_COMPARE(downloads.bytesReceived(), 30);
+    QCOMPARE(value(downloads, "nodes", "downloads"), 1);
+    downloads.reset();
+    QCOMPARE(downloads.bytesReceived(), 0);
+    QVERIFY(downloads.categories().isEmpty());
+}
+
+void TestDownloads::startAndEndPerReply() {
+    Downloads downloads(nullptr);
+    QSignalSpy started(&downloads, &Downloads::downloadStart);
+    QSignalSpy ended(&downloads, &Downloads::downloadEnd);
+    QSignalSpy downloading(&downloads, &Downloads::downloadingChanged);
+    auto first = new FakeReply;
+    auto second = new FakeReply;
+    downloads.setProgress(first, 0, 10, Downloads::Images);
+    downloads.monitor(second, []() {return nullptr;});
+    downloads.setProgress(second, 0, 10, Downloads::Images);
+    QCOMPARE(started.count(), 2);
+    QCOMPARE(downloading.count(), 1);
+    delete first;
+    QCOMPARE(ended.count(), 1);
+    QCOMPARE(downloading.count(), 1);
+    delete second;
+    QCOMPARE(ended.count(), 2);
+    QCOMPARE(downloading.count(), 2);
+}
+
+QTEST_GUILESS_MAIN(TestDownloads)
+#include "tst_downloads.moc"
@@ -0,0 +1,104 @@
+#include "figmadata.h"
+#include <QTest>
+
+class TestFigmaBlobs : public QObject {
+    Q_OBJECT
+private slots:
+    void refCounted();
+    void sharedByCaches();
+    void commitRefused();
+    void spilledAndReadBack();
+    void budgetLowered();
+};
+
+void TestFigmaBlobs::refCounted() {
+    FigmaBlobs blobs;
+    const QByteArray bytes(100, 'a');
+    QByteArray first, second;
+    blobs.intern(bytes, first);
+    blobs.intern(bytes, second);
+    QCOMPARE(first, second);
+    QCOMPARE(blobs.size(), 1);
+    QCOMPARE(blobs.bytes(), 100);
+    blobs.release(first);
+    QCOMPARE(blobs.get(second).value_or(QByteArray()), bytes);
+    blobs.release(second);
+    QCOMPARE(blobs.size(), 0);
+    QCOMPARE(blobs.bytes(), 0);
+    QVERIFY(!blobs.get(second));
+}
+
+// identical images and renderings keep one copy, it lives until the last cache lets it go
+void TestFigmaBlobs::sharedByCaches() {
+    const auto blobs = std::make_shared<FigmaBlobs>();
+    const QByteArray bytes(100, 'i');
+    FigmaData images(blobs);
+    FigmaData renderings(blobs);
+    images.insert("1:1");
+    images.insert("1:2");
+    renderings.insert("1:1");
+    QVERIFY(images.commit("1:1", bytes));
+    QVERIFY(images.commit("1:2", bytes));
+    QVERIFY(renderings.commit("1:1", bytes));
+    QCOMPARE(blobs->size(), 1);
+    QCOMPARE(blobs->bytes(), 100);
+    QCOMPARE(std::get<QByteArray>(renderings.committed("1:1").value()), bytes);
+    images.clear();
+    QCOMPARE(blobs->size(), 1);
+    QCOMPARE(std::get<QByteArray>(renderings.committed("1:1").value()), bytes);
+    renderings.clear();
+    QCOMPARE(blobs->size(), 0);
+}
+
+void TestFigmaBlobs::commitRefused() {
+    const auto blobs = std::make_shared<FigmaBlobs>();
+    FigmaData images(blobs);
+    QVERIFY(!images.commit("1:1", "missing"));
+    QCOMPARE(blobs->size(), 0);
+    images.insert("1:1");
+    QVERIFY(images.commit("1:1", "first"));
+    QVERIFY(!images.commit("1:1", "second"));
+    QCOMPARE(blobs->size(), 1);
+    images.clear();
+    QCOMPARE(blobs->size(), 0);
+}
+
+// over the budget the least recently used are written out, the newest stays in memory
+void TestFigmaBlobs::spilledAndReadBack() {
+    FigmaBlobs blobs;
+    blobs.setBudget(250);
+    const QByteArray a(100, 'a'), b(100, 'b'), c(100, 'c');
+    QByteArray ha, hb, hc;
+    blobs.intern(a, ha);
+    blobs.intern(b, hb);
+    QCOMPARE(blobs.get(ha).value_or(QByteArray()), a); // b is now the least recently used
+    blobs.intern(c, hc);
+    QCOMPARE(blobs.size(), 3);
+    QCOMPARE(blobs.bytes(), 200);
+    QCOMPARE(blobs.get(hb).value_or(QByteArray()), b); // read back, spills a
+    QCOMPARE(blobs.bytes(), 200);
+    QCOMPARE(blobs.get(ha).value_or(QByteArray()), a);
+    QCOMPARE(blobs.get(hc).value_or(QByteArray()), c);
+    QVERIFY(blobs.bytes() <= 250);
+    blobs.release(ha);
+    blobs.release(hb);
+    blobs.release(hc);
+    QCOMPARE(blobs.size(), 0);
+    QCOMPARE(blobs.bytes(), 0);
+}
+
+void TestFigmaBlobs::budgetLowered() {
+    FigmaBlobs blobs;
+    QList<QByteArray> hashes(3);
+    for(int i = 0; i < hashes.size(); ++i)
+        blobs.intern(QByteArray(100, char('a' + i)), hashes[i]);
+    QCOMPARE(blobs.bytes(), 300);
+    blobs.setBudget(100);
+    QCOMPARE(blobs.bytes(), 100);
+    for(int i = 0; i < hashes.size(); ++i)
+        QCOMPARE(blobs.get(hashes[i]).value_or(QByteArray()), QByteArray(100, char('a' + i)));
+    QCOMPARE(blobs.bytes(), 100);
+}
+
+QTEST_GUILESS_MAIN(TestFigmaBlobs)
+#include "tst_figmablobs.moc"
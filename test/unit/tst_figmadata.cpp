@@ -0,0 +1,59 @@
+#include "figmadata.h"
+#include <QTest>
+#include <QTemporaryDir>
+
+class TestFigmaData : public QObject {
+    Q_OBJECT
+private slots:
+    void restoredNodeReadTwice();
+    void restoredNodeWrittenAgain();
+};
+
+// nodes have no FigmaBlobs, a loaded entry keeps its bytes
+void TestFigmaData::restoredNodeReadTwice() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath("nodes.figmaqml");
+    FigmaStore::Writer writer(fileName);
+    QVERIFY(writer.add(FigmaStore::Nodes, "1:2", {}, 0, "{\"node\":1}"));
+    QVERIFY(writer.commit({}));
+
+    auto store = std::make_shared<FigmaStore>();
+    QVERIFY(store->open(fileName));
+    FigmaData nodes;
+    nodes.read(store, FigmaStore::Nodes);
+
+    for(int i = 0; i < 2; ++i) {
+        const auto node = nodes.committed("1:2");
+        QVERIFY(node);
+        QCOMPARE(std::get<QByteArray>(*node), QByteArray("{\"node\":1}"));
+    }
+    QVERIFY(nodes.entry("1:2")->hash.isEmpty());
+}
+
+void TestFigmaData::restoredNodeWrittenAgain() {
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto fileName = dir.filePath("nodes.figmaqml");
+    {
+        FigmaStore::Writer writer(fileName);
+        QVERIFY(writer.add(FigmaStore::Nodes, "1:2", {}, 0, "{\"node\":1}"));
+        QVERIFY(writer.commit({}));
+    }
+    auto store = std::make_shared<FigmaStore>();
+    QVERIFY(store->open(fileName));
+    FigmaData nodes;
+    nodes.read(store, FigmaStore::Nodes);
+    QVERIFY(nodes.committed("1:2"));
+
+    const auto copyName = dir.filePath("copy.figmaqml");
+    FigmaStore::Writer writer(copyName);
+    QVERIFY(nodes.write(writer, FigmaStore::Nodes));
+    QVERIFY(writer.commit({}));
+    FigmaStore copy;
+    QVERIFY(copy.open(copyName));
+    QCOMPARE(copy.load(FigmaStore::Nodes, "1:2").value_or(QByteArray()), QByteArray("{\"node\":1}"));
+}
+
+QTEST_GUILESS_MAIN(TestFigmaData)
+#include "tst_figmadata.moc"
@@ -0,0 +1,77 @@
+#include "figmaget.h"
+#include "mockserver.h"
+#include <QTest>
+#include <QSignalSpy>
+#include <QImage>
+#include <QBuffer>
+
+class TestFigmaGet : public QObject {
+    Q_OBJECT
+private slots:
+    void init();
+    void cleanup();
+    void nodesRetriedAsBatch();
+    void renderingChunkRetried();
+private:
+    std::unique_ptr<MockServer> m_server;
+    std::unique_ptr<FigmaGet> m_get;
+};
+
+void TestFigmaGet::init() {
+    m_server = std::make_unique<MockServer>();
+    m_get = std::make_unique<FigmaGet>();
+    m_get->setProperty("apiUrl", m_server->url("/").toString());
+    m_get->setProperty("projectToken", "project");
+    m_get->setProperty("userToken", "user");
+    m_get->setProperty("throttle", 0);
+}
+
+void TestFigmaGet::cleanup() {
+    m_get.reset();
+    m_server.reset();
+}
+
+// a throttled batch is requested again with its own ids, they were already taken from the queue
+void TestFigmaGet::nodesRetriedAsBatch() {
+    const auto path = QString("/files/project/nodes");
+    m_server->respond(path, {429, "Retry-After: 0\r\n"});
+    m_server->respond(path, {200, {}, R"({"nodes":{"1:1":{"document":{"id":"1:1"}},"1:2":{"document":{"id":"1:2"}}}})"});
+    QSignalSpy ready(m_get.get(), &FigmaProvider::nodeReady);
+    QSignalSpy error(m_get.get(), &FigmaGet::error);
+    m_get->getNode("1:1");
+    m_get->getNode("1:2"); // same event loop round, hence the same batch
+    QTRY_COMPARE_WITH_TIMEOUT(ready.count(), 2, 5000);
+    QCOMPARE(error.count(), 0);
+    const auto targets = m_server->targets(path);
+    QCOMPARE(targets.size(), 2);
+    QCOMPARE(targets[1], targets[0]);
+    QVERIFY(m_get->cachedNode("1:1"));
+    QVERIFY(m_get->cachedNode("1:2"));
+}
+
+// neither a throttled nor a failed chunk loses its ids, they are requested again
+void TestFigmaGet::renderingChunkRetried() {
+    const auto path = QString("/images/project");
+    m_server->respond(path, {429, "Retry-After: 0\r\n"});
+    m_server->respond(path, {500});
+    const auto imageUrl = m_server->url("/rendered/1").toString();
+    m_server->respond(path, {200, {}, QString(R"({"images":{"1:1":"%1"}})").arg(imageUrl).toUtf8()});
+    QImage image(2, 2, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    QByteArray png;
+    QBuffer buffer(&png);
+    QVERIFY(image.save(&buffer, "PNG"));
+    m_server->respond("/rendered/1", {200, "Content-Type: image/png\r\n", png});
+
+    QSignalSpy ready(m_get.get(), &FigmaProvider::renderingReady);
+    QSignalSpy error(m_get.get(), &FigmaGet::error);
+    m_get->getRendering("1:1");
+    QTRY_COMPARE_WITH_TIMEOUT(ready.count(), 1, 10000);
+    QCOMPARE(ready[0][0].toString(), QString("1:1"));
+    QCOMPARE(error.count(), 0);
+    QCOMPARE(m_server->hits(path).size(), 3);
+    QCOMPARE(m_get->renderingStats().value("retried").toInt(), 2);
+}
+
+QTEST_GUILESS_MAIN(TestFigmaGet)
+#include "tst_figmaget.moc"
@@ -0,0 +1,122 @@
+#include "figmastore.h"
+#include <QTest>
+#include <QTemporaryDir>
+#include <QFileInfo>
+#include <atomic>
+#include <thread>
+
+class TestFigmaStore : public QObject {
+    Q_OBJECT
+private slots:
+    void init();
+    void replaceAndLoad();
+    void appendSupersedes();
+    void compact();
+    void appendRolledBack();
+    void updateWhileLoading();
+private:
+    bool write(FigmaStore::Writer::Mode mode, const QList<QPair<QString, QByteArray>>& nodes, bool commit = true);
+    std::unique_ptr<QTemporaryDir> m_dir;
+    QString m_fileName;
+};
+
+void TestFigmaStore::init() {
+    m_dir = std::make_unique<QTemporaryDir>();
+    QVERIFY(m_dir->isValid());
+    m_fileName = m_dir->filePath("test.figmaqml");
+}
+
+bool TestFigmaStore::write(FigmaStore::Writer::Mode mode, const QList<QPair<QString, QByteArray>>& nodes, bool commit) {
+    FigmaStore::Writer writer(m_fileName, mode);
+    for(const auto& [id, bytes] : nodes) {
+        if(!writer.add(FigmaStore::Nodes, id, {}, 0, bytes))
+            return false;
+    }
+    return !commit || writer.commit({"project", "1", 0, {}});
+}
+
+void TestFigmaStore::replaceAndLoad() {
+    QVERIFY(write(FigmaStore::Writer::Mode::Replace, {{"1:1", "{\"a\":1}"}, {"1:2", "{\"b\":2}"}}));
+    QVERIFY(FigmaStore::isStore(m_fileName));
+    FigmaStore store;
+    QVERIFY(store.open(m_fileName));
+    QCOMPARE(store.meta().projectToken, QString("project"));
+    QCOMPARE(store.ids(FigmaStore::Nodes).size(), 2);
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:2").value_or(QByteArray()), QByteArray("{\"b\":2}"));
+    QVERIFY(!store.load(FigmaStore::Nodes, "1:3"));
+    QCOMPARE(store.superseded(), 0);
+}
+
+void TestFigmaStore::appendSupersedes() {
+    QVERIFY(write(FigmaStore::Writer::Mode::Replace, {{"1:1", "{\"a\":1}"}, {"1:2", "{\"b\":2}"}}));
+    const auto size = QFileInfo(m_fileName).size();
+    QVERIFY(write(FigmaStore::Writer::Mode::Append, {{"1:1", "{\"a\":3}"}, {"1:2", "{\"b\":2}"}, {"1:3", "{\"c\":4}"}}));
+    QVERIFY(QFileInfo(m_fileName).size() > size);
+    FigmaStore store;
+    QVERIFY(store.open(m_fileName));
+    QCOMPARE(store.ids(FigmaStore::Nodes).size(), 3);
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:1").value_or(QByteArray()), QByteArray("{\"a\":3}"));
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:2").value_or(QByteArray()), QByteArray("{\"b\":2}"));
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:3").value_or(QByteArray()), QByteArray("{\"c\":4}"));
+    QVERIFY(store.superseded() > 0); // the first "1:1" and index
+}
+
+void TestFigmaStore::compact() {
+    QVERIFY(write(FigmaStore::Writer::Mode::Replace, {{"1:1", "{\"a\":1}"}}));
+    QVERIFY(write(FigmaStore::Writer::Mode::Append, {{"1:1", "{\"a\":2}"}, {"1:2", "{\"b\":2}"}}));
+    FigmaStore store;
+    QVERIFY(store.open(m_fileName));
+    const auto size = QFileInfo(m_fileName).size();
+    QVERIFY(store.compact());
+    QVERIFY(store.isOpen());
+    QCOMPARE(store.superseded(), 0);
+    QVERIFY(QFileInfo(m_fileName).size() < size);
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:1").value_or(QByteArray()), QByteArray("{\"a\":2}"));
+    QCOMPARE(store.load(FigmaStore::Nodes, "1:2").value_or(QByteArray()), QByteArray("{\"b\":2}"));
+    QCOMPARE(store.meta().version, QString("1"));
+}
+
+void TestFigmaStore::appendRolledBack() {
+    QVERIFY(write(FigmaStore::Writer::Mode::Replace, {{"1:1", "{\"a\":1}"}}));
+    const auto size = QFileInfo(m_fileName).size();
+    QVERIFY(write(FigmaStore::Writer::Mode::Append, {{"1:2", "{\"b\":2}"}}, false));
+    QCOMPARE(QFileInfo(m_fileName).size(), size);
+    FigmaStore store;
+    QVERIFY(store.open(m_fileName));
+    QCOMPARE(store.ids(FigmaStore::Nodes), QStringList{"1:1"});
+}
+
+// loads from another thread see either the old or the new file, never one being written
+void TestFigmaStore::updateWhileLoading() {
+    QList<QPair<QString, QByteArray>> nodes;
+    for(int i = 0; i < 100; ++i)
+        nodes.append({QString("1:%1").arg(i), QByteArray("{\"n\":") + QByteArray::number(i) + '}'});
+    QVERIFY(write(FigmaStore::Writer::Mode::Replace, nodes));
+    FigmaStore store;
+    QVERIFY(store.open(m_fileName));
+
+    std::atomic_bool done = false;
+    std::atomic_int failed = 0;
+    std::thread loader([&]() {
+        for(int i = 0; !done; i = (i + 1) % nodes.size()) {
+            if(store.load(FigmaStore::Nodes, nodes[i].first) != nodes[i].second)
+                ++failed;
+        }
+    });
+    int updated = 0;
+    for(int round = 0; round < 20; ++round) {
+        FigmaStore::Writer writer(m_fileName, round % 2 ? FigmaStore::Writer::Mode::Append : FigmaStore::Writer::Mode::Replace);
+        auto added = true;
+        for(const auto& [id, bytes] : nodes)
+            added = writer.add(FigmaStore::Nodes, id, {}, 0, bytes) && added;
+        if(added && store.update([&writer]() {return writer.commit({"project", "1", 0, {}});}))
+            ++updated;
+    }
+    done = true;
+    loader.join(); // before any check may return
+    QCOMPARE(updated, 20);
+    QCOMPARE(failed.load(), 0);
+}
+
+QTEST_GUILESS_MAIN(TestFigmaStore)
+#include "tst_figmastore.moc"
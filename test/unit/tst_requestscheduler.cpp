@@ -0,0 +1,105 @@
+#include "requestscheduler.h"
+#include "mockserver.h"
+#include <QTest>
+#include <QSignalSpy>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+
+class TestRequestScheduler : public QObject {
+    Q_OBJECT
+private slots:
+    void tokenBucket();
+    void emptyCallKeepsToken();
+    void contentNotRateLimited();
+    void backoffOnTooManyRequests();
+    void retryKeepsKind();
+    void retryOnBadRequest();
+private:
+    RequestScheduler::NetworkFunction get(const QString& path) {
+        return [this, path]() {
+            auto reply = m_manager.get(QNetworkRequest(m_server.url(path)));
+            QObject::connect(reply, &QNetworkReply::finished, reply, &QObject::deleteLater);
+            return reply;
+        };
+    }
+    MockServer m_server;
+    QNetworkAccessManager m_manager;
+};
+
+// a burst is dispatched at once, then a call per interval
+void TestRequestScheduler::tokenBucket() {
+    RequestScheduler scheduler;
+    scheduler.setBurst(2);
+    scheduler.setInterval(1000);
+    QSignalSpy dispatched(&scheduler, &RequestScheduler::dispatched);
+    for(int i = 0; i < 3; ++i)
+        scheduler.enqueue(get("/bucket"));
+    QTRY_COMPARE(dispatched.count(), 2);
+    QTest::qWait(300);
+    QCOMPARE(dispatched.count(), 2);
+    QTRY_COMPARE_WITH_TIMEOUT(dispatched.count(), 3, 2000);
+    QTRY_VERIFY(scheduler.isEmpty() && scheduler.inFlight() == 0);
+}
+
+void TestRequestScheduler::emptyCallKeepsToken() {
+    RequestScheduler scheduler;
+    scheduler.setBurst(1);
+    scheduler.setInterval(60000);
+    int called = 0;
+    scheduler.enqueue([&called]() -> QNetworkReply* {++called; return nullptr;});
+    QSignalSpy dispatched(&scheduler, &RequestScheduler::dispatched);
+    scheduler.enqueue(get("/token"));
+    QTRY_COMPARE(dispatched.count(), 1);
+    QCOMPARE(called, 1);
+}
+
+void TestRequestScheduler::contentNotRateLimited() {
+    RequestScheduler scheduler;
+    scheduler.setBurst(1);
+    scheduler.setInterval(60000);
+    scheduler.setConcurrency(10);
+    QSignalSpy dispatched(&scheduler, &RequestScheduler::dispatched);
+    for(int i = 0; i < 5; ++i)
+        scheduler.enqueue(get("/content"), RequestScheduler::Kind::Content);
+    QTRY_COMPARE(dispatched.count(), 5);
+    QTRY_COMPARE(m_server.hits("/content").size(), 5);
+}
+
+// 429 pauses API calls for Retry-After and the call is run again
+void TestRequestScheduler::backoffOnTooManyRequests() {
+    RequestScheduler scheduler;
+    scheduler.setInterval(0);
+    QSignalSpy throttled(&scheduler, &RequestScheduler::throttled);
+    m_server.respond("/limited", {429, "Retry-After: 1\r\n"});
+    scheduler.enqueue(get("/limited"));
+    QTRY_COMPARE(throttled.count(), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(m_server.hits("/limited").size(), 2, 5000);
+    const auto hits = m_server.hits("/limited");
+    QVERIFY(hits[1] - hits[0] >= 900);
+    QTRY_VERIFY(scheduler.isEmpty() && scheduler.inFlight() == 0);
+}
+
+// a content call told to retry is not held back by the API token bucket
+void TestRequestScheduler::retryKeepsKind() {
+    RequestScheduler scheduler;
+    scheduler.setBurst(1);
+    scheduler.setInterval(60000);
+    m_server.respond("/image", {429, "Retry-After: 0\r\n"});
+    scheduler.enqueue(get("/image"), RequestScheduler::Kind::Content);
+    QTRY_COMPARE_WITH_TIMEOUT(m_server.hits("/image").size(), 2, 5000);
+}
+
+// Figma answers 400 when overloaded, the call is run again after a default backoff
+void TestRequestScheduler::retryOnBadRequest() {
+    RequestScheduler scheduler;
+    scheduler.setInterval(0);
+    QSignalSpy throttled(&scheduler, &RequestScheduler::throttled);
+    m_server.respond("/bad", {400, {}});
+    scheduler.enqueue(get("/bad"));
+    QTRY_COMPARE(throttled.count(), 1);
+    QTRY_COMPARE_WITH_TIMEOUT(m_server.hits("/bad").size(), 2, 5000);
+    QTRY_VERIFY(scheduler.isEmpty() && scheduler.inFlight() == 0);
+}
+
+QTEST_GUILESS_MAIN(TestRequestScheduler)
+#include "tst_requestscheduler.moc"
@@ -0,0 +1,83 @@
+#include "searchindex.h"
+#include <QTest>
+
+using Kind = SearchIndex::Kind;
+
+class TestSearchIndex : public QObject {
+    Q_OBJECT
+private slots:
+    void prefix();
+    void intersection();
+    void insertedAgain();
+    void ordered();
+private:
+    static QStringList texts(const QVector<SearchIndex::Hit>& hits) {
+        QStringList list;
+        for(const auto& hit : hits)
+            list.append(hit.text);
+        return list;
+    }
+};
+
+// each query word matches the beginning of a word, case insensitively
+void TestSearchIndex::prefix() {
+    SearchIndex index;
+    index.insert("Main.qml", {
+                     {Kind::Name, "Submit Button", "1:1", 0, 0, "Main.qml", 3},
+                     {Kind::Text, "Cancel", "1:2", 0, 0, "Main.qml", 7},
+                     {Kind::Id, "12:34", "12:34", 0, 0, "Main.qml", 9}});
+    QCOMPARE(texts(index.find("butt", 0)), QStringList{"Submit Button"});
+    QCOMPARE(texts(index.find("CAN", 0)), QStringList{"Cancel"});
+    QCOMPARE(texts(index.find("34", 0)), QStringList{"12:34"});
+    QVERIFY(index.find("ton", 0).isEmpty());
+    QVERIFY(index.find("  ,", 0).isEmpty());
+}
+
+// a hit must match every word of the query
+void TestSearchIndex::intersection() {
+    SearchIndex index;
+    index.insert("Main.qml", {
+                     {Kind::Name, "Submit Button", "1:1", 0, 0, "Main.qml", 3},
+                     {Kind::Name, "Cancel Button", "1:2", 0, 0, "Main.qml", 5},
+                     {Kind::Text, "Submit", "1:3", 0, 0, "Main.qml", 8}});
+    QCOMPARE(texts(index.find("button", 0)), (QStringList{"Submit Button", "Cancel Button"}));
+    QCOMPARE(texts(index.find("sub but", 0)), QStringList{"Submit Button"});
+    QCOMPARE(texts(index.find("submit", 0)), (QStringList{"Submit Button", "Submit"}));
+    QVERIFY(index.find("cancel submit", 0).isEmpty());
+    QCOMPARE(index.find("button", 1).size(), 1);
+}
+
+// a file generated again replaces its hits, other files keep theirs
+void TestSearchIndex::insertedAgain() {
+    SearchIndex index;
+    index.insert("Main.qml", {{Kind::Name, "Old Frame", "1:1", 0, 0, "Main.qml", 2}});
+    index.insert("Other.qml", {{Kind::Name, "Other Frame", "2:1", 1, 0, "Other.qml", 2}});
+    QCOMPARE(index.size(), 2);
+    index.insert("Main.qml", {
+                     {Kind::Name, "New Frame", "1:1", 0, 0, "Main.qml", 2},
+                     {Kind::Text, "Label", "1:2", 0, 0, "Main.qml", 6}});
+    QCOMPARE(index.size(), 3);
+    QVERIFY(index.find("old", 0).isEmpty());
+    QCOMPARE(texts(index.find("frame", 0)), (QStringList{"New Frame", "Other Frame"}));
+    index.insert("Main.qml", {});
+    QCOMPARE(index.size(), 1);
+    QVERIFY(index.find("label", 0).isEmpty());
+    index.clear();
+    QCOMPARE(index.size(), 0);
+    QVERIFY(index.find("other", 0).isEmpty());
+}
+
+// as in the document, components after canvases
+void TestSearchIndex::ordered() {
+    SearchIndex index;
+    index.insert("ButtonComponent.qml", {{Kind::Component, "Button", "3:1", -1, -1, "ButtonComponent.qml", 1}});
+    index.insert("Second.qml", {{Kind::Instance, "Button second", "2:5", 1, 0, "Second.qml", 4}});
+    index.insert("First.qml", {
+                     {Kind::Instance, "Button lower", "1:9", 0, 0, "First.qml", 20},
+                     {Kind::Instance, "Button upper", "1:5", 0, 0, "First.qml", 10}});
+    QCOMPARE(texts(index.find("button", 0)), (QStringList{"Button upper", "Button lower", "Button second", "Button"}));
+    QCOMPARE(SearchIndex::kindName(Kind::Instance), QString("instance"));
+}
+
+QTEST_GUILESS_MAIN(TestSearchIndex)
+#include "tst_searchindex.moc"
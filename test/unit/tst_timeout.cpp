@@ -0,0 +1,90 @@
+#include "functorslot.h"
+#include <QTest>
+#include <QSignalSpy>
+
+class TestTimeout : public QObject {
+    Q_OBJECT
+private slots:
+    void expires();
+    void cancelled();
+    void cancelExpired();
+    void nextRound();
+    void setFromCallback();
+    void reset();
+};
+
+void TestTimeout::expires() {
+    Timeout timeout;
+    QSignalSpy purged(&timeout, &Timeout::purged);
+    int called = 0;
+    timeout.set("a", Timeout::TickMs, [&called]() {++called;});
+    QCOMPARE(timeout.pending(), 1);
+    QTRY_COMPARE(called, 1);
+    QCOMPARE(timeout.pending(), 0);
+    QTRY_COMPARE(purged.count(), 1);
+    QTest::qWait(3 * Timeout::TickMs);
+    QCOMPARE(called, 1);
+}
+
+void TestTimeout::cancelled() {
+    Timeout timeout;
+    QSignalSpy purged(&timeout, &Timeout::purged);
+    int called = 0;
+    timeout.set("a", Timeout::TickMs, [&called]() {++called;});
+    timeout.set("b", 2 * Timeout::TickMs, [&called]() {called += 10;});
+    timeout.cancel("a");
+    QCOMPARE(timeout.pending(), 1);
+    QCOMPARE(purged.count(), 0);
+    QTRY_COMPARE(called, 10);
+    QCOMPARE(purged.count(), 1);
+}
+
+void TestTimeout::cancelExpired() {
+    Timeout timeout;
+    bool called = false;
+    timeout.set("a", Timeout::TickMs, [&called]() {called = true;});
+    QTRY_VERIFY(called);
+    timeout.cancel("a");
+    timeout.cancel("never set");
+    QCOMPARE(timeout.pending(), 0);
+}
+
+// longer than a round of the wheel, the slot is passed once before it expires
+void TestTimeout::nextRound() {
+    Timeout timeout;
+    bool late = false;
+    bool early = false;
+    timeout.set("late", (Timeout::WheelSize + 1) * Timeout::TickMs, [&late]() {late = true;});
+    timeout.set("early", Timeout::TickMs, [&early]() {early = true;});
+    QTRY_VERIFY(early);
+    QTest::qWait(3 * Timeout::TickMs);
+    QVERIFY(!late);
+    QCOMPARE(timeout.pending(), 1);
+}
+
+void TestTimeout::setFromCallback() {
+    Timeout timeout;
+    int called = 0;
+    timeout.set("a", Timeout::TickMs, [&]() {
+        ++called;
+        timeout.set("a", Timeout::TickMs, [&called]() {++called;});
+    });
+    QTRY_COMPARE(called, 2);
+    QCOMPARE(timeout.pending(), 0);
+}
+
+void TestTimeout::reset() {
+    Timeout timeout;
+    QSignalSpy purged(&timeout, &Timeout::purged);
+    bool called = false;
+    timeout.set("a", Timeout::TickMs, [&called]() {called = true;});
+    timeout.set("b", Timeout::TickMs, [&called]() {called = true;});
+    timeout.reset();
+    QCOMPARE(timeout.pending(), 0);
+    QCOMPARE(purged.count(), 1);
+    QTest::qWait(3 * Timeout::TickMs);
+    QVERIFY(!called);
+}
+
+QTEST_GUILESS_MAIN(TestTimeout)
+#include "tst_timeout.moc"